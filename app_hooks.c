@@ -0,0 +1,40 @@
+/*
+ * @brief uC/OS-II application hooks, called from the port's OS hooks when
+ *        OS_APP_HOOKS_EN is set.
+ */
+
+#include <ucos_ii.h>
+#include "tickless.h"
+
+#if (OS_APP_HOOKS_EN > 0)
+
+void App_TaskCreateHook(OS_TCB *ptcb) {
+	(void)ptcb;
+}
+
+void App_TaskDelHook(OS_TCB *ptcb) {
+	(void)ptcb;
+}
+
+void App_TaskIdleHook(void) {
+	ticklessIdle();
+}
+
+void App_TaskReturnHook(OS_TCB *ptcb) {
+	(void)ptcb;
+}
+
+void App_TaskStatHook(void) {
+}
+
+void App_TaskSwHook(void) {
+}
+
+void App_TCBInitHook(OS_TCB *ptcb) {
+	(void)ptcb;
+}
+
+void App_TimeTickHook(void) {
+}
+
+#endif
@@ -1,46 +1,73 @@
 #include <stdint.h>
 #include "buffer.h"
+#include "timer.h"
+#include "taskmon.h"
 #include <ucos_ii.h>
 
-static message_t buffer [BUF_SIZE];
-static uint8_t front = 0;
-static uint8_t back = 0;
-OS_EVENT *bufMutex;
-OS_EVENT *emptySlot;
-OS_EVENT *fullSlot;
+void bufferSaveInit(buffer_t * const buf, message_t * const slots, uint8_t capacity) {
+	buf->slots = slots;
+	buf->capacity = capacity;
+	buf->front = 0;
+	buf->back = 0;
+	buf->bufMutex = OSSemCreate(1);
+	buf->emptySlot = OSSemCreate(capacity);
+	buf->fullSlot = OSSemCreate(0);
+}
+
+void putBuffer (buffer_t * const buf, message_t const * const msg) {
+	buf->slots [buf->back] = *msg;
+	buf->back = ( buf->back + 1 ) % buf->capacity ;
+}
 
-void bufferSaveInit(void) {
-	bufMutex = OSSemCreate(1);
-	emptySlot = OSSemCreate(BUF_SIZE);
-	fullSlot = OSSemCreate(0);
+void getBuffer (buffer_t * const buf, message_t * const msg) {
+	*msg = buf->slots [buf->front] ;
+	buf->front = (buf->front + 1) % buf->capacity ;
 }
 
-void putBuffer (message_t const * const msg) {
-	buffer [back] = *msg;
-	back = ( back + 1 ) % BUF_SIZE ;
+void putBufferSave (buffer_t * const buf, message_t const * const msg) {
+	putBufferSaveTimed(buf, msg, TASKMON_NONE, usTimeNow());   /* stamped before any wait for a free slot */
 }
 
-void getBuffer (message_t * const msg) {
-	*msg = buffer [front] ;
-	front = (front + 1) % BUF_SIZE ;
+void putBufferSaveTimed (buffer_t * const buf, message_t const * const msg, uint8_t monitor, uint32_t sinceUs) {
+	uint8_t status;
+	message_t stamped = *msg;
+	
+	stamped.postedUs = sinceUs;
+	stamped.monitor = monitor;
+	OSSemPend(buf->emptySlot, 0, &status);
+	OSSemPend(buf->bufMutex, 0, &status);
+	putBuffer(buf, &stamped);
+	status = OSSemPost(buf->bufMutex);
+	status = OSSemPost(buf->fullSlot);
 }
 
-void putBufferSave (message_t const * const msg) {
+void getBufferSave (buffer_t * const buf, message_t * const msg) {
 	uint8_t status;
 	
-	OSSemPend(emptySlot, 0, &status);
-	OSSemPend(bufMutex, 0, &status);
-	putBuffer(msg);
-	status = OSSemPost(bufMutex);
-	status = OSSemPost(fullSlot);
+	OSSemPend(buf->fullSlot, 0, &status);
+	OSSemPend(buf->bufMutex, 0, &status);
+	getBuffer(buf, msg);
+	status = OSSemPost(buf->bufMutex);
+	status = OSSemPost(buf->emptySlot);
 }
 
-void getBufferSave (message_t * const msg) {
+bool tryGetBufferSave (buffer_t * const buf, message_t * const msg, uint16_t timeout) {
 	uint8_t status;
 	
-	OSSemPend(fullSlot, 0, &status);
-	OSSemPend(bufMutex, 0, &status);
-	getBuffer(msg);
-	status = OSSemPost(bufMutex);
-	status = OSSemPost(emptySlot);
+	if (timeout == 0) {
+		if (OSSemAccept(buf->fullSlot) == 0) {
+			return false;
+		}
+	}
+	else {
+		OSSemPend(buf->fullSlot, timeout, &status);
+		if (status != OS_ERR_NONE) {
+			return false;
+		}
+	}
+	OSSemPend(buf->bufMutex, 0, &status);
+	getBuffer(buf, msg);
+	status = OSSemPost(buf->bufMutex);
+	status = OSSemPost(buf->emptySlot);
+	return true;
 }
@@ -1,21 +1,47 @@
 #ifndef __BUFFER_H
 #define __BUFFER_H
 #include <stdint.h>
-
-enum {
-	BUF_SIZE = 4UL
-};
+#include <ucos_ii.h>
 
 typedef struct message {
 	uint32_t taskId;
 	//uint32_t dataValue;
 	uint8_t dataArray[4];	
+	uint32_t postedUs;      /* usTimeNow() when putBufferSave was called */
+	uint8_t monitor;        /* taskmon id timed from postedUs until the message is on screen, or TASKMON_NONE */
 } message_t ;
 
-void bufferSaveInit(void);
-void putBuffer (message_t const * const);
-void getBuffer (message_t * const);
-void putBufferSave (message_t const * const);
-void getBufferSave (message_t * const);
+/*
+ * @brief One bounded message queue. Every application instance owns its
+ *        own buffer, so several copies of the application can run side by
+ *        side without sharing queue state. The storage and its capacity
+ *        come from the application's queue table.
+ */
+typedef struct buffer {
+	message_t *slots;
+	uint8_t capacity;
+	uint8_t front;
+	uint8_t back;
+	OS_EVENT *bufMutex;
+	OS_EVENT *emptySlot;
+	OS_EVENT *fullSlot;
+} buffer_t ;
+
+void bufferSaveInit(buffer_t * const, message_t * const, uint8_t);
+void putBuffer (buffer_t * const, message_t const * const);
+void getBuffer (buffer_t * const, message_t * const);
+void putBufferSave (buffer_t * const, message_t const * const);
+/*
+ * @brief Like putBufferSave, but the message carries sinceUs instead of the
+ *        time of the call, and the consumer records its delivery against
+ *        taskmon id monitor.
+ */
+void putBufferSaveTimed (buffer_t * const, message_t const * const, uint8_t monitor, uint32_t sinceUs);
+void getBufferSave (buffer_t * const, message_t * const);
+/*
+ * @brief Like getBufferSave, but gives up after timeout ticks and returns
+ *        false. A timeout of 0 only takes a message that is already queued.
+ */
+bool tryGetBufferSave (buffer_t * const, message_t * const, uint16_t timeout);
 
 #endif
@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include "crc16.h"
+
+uint16_t crc16(uint8_t const *data, uint32_t len) {
+	uint16_t crc = 0xFFFFU;
+	uint32_t i;
+	uint8_t bit;
+
+	for (i = 0; i < len; i++) {
+		crc ^= (uint16_t)data[i] << 8;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ 0x1021U) : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
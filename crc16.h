@@ -0,0 +1,20 @@
+#ifndef __CRC16_H__
+#define __CRC16_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * @brief CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), as
+ *        used by the event log pages and records and the telemetry frames.
+ */
+uint16_t crc16(uint8_t const *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
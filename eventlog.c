@@ -0,0 +1,335 @@
+
+#include <string.h>
+#include <LPC407x_8x_177x_8x.h>
+#include <ucos_ii.h>
+#include "eventlog.h"
+#include "crc16.h"
+
+enum {
+	EEPROM_CMD_READ32      = 2UL,
+	EEPROM_CMD_WRITE32     = 5UL,
+	EEPROM_CMD_PROG_PAGE   = 6UL,
+	EEPROM_CMD_RDPREFETCH  = (1UL << 3),
+	EEPROM_END_OF_RDWR     = (1UL << 26),
+	EEPROM_END_OF_PROG     = (1UL << 28)
+};
+
+enum {
+	EVENTLOG_MAGIC = 0x4C47U   /* "GL" */
+};
+
+typedef struct {
+	uint32_t seq;              /* increases by one for every page started */
+	uint16_t magic;
+	uint16_t crc;              /* CRC-16/CCITT over seq and magic */
+	eventRecord_t records[EVENTLOG_RECORDS_PER_PAGE];
+} eventPage_t;
+
+static eventPage_t work;       /* page currently being filled */
+static eventPage_t pending;    /* full page waiting to be programmed */
+static uint8_t workPage;       /* EEPROM page that work belongs to */
+static uint8_t pendingPage;
+static uint8_t workCount;      /* records held in work */
+static bool workDirty;         /* work holds records not yet in EEPROM */
+static bool pendingValid;
+static uint8_t validPages;     /* pages, including work, that hold records */
+static eventLogStats_t stats;
+static OS_EVENT *pageReady;
+
+static bool headerValid(eventPage_t const *page) {
+	return (page->magic == EVENTLOG_MAGIC) &&
+	       (page->crc == crc16((uint8_t const *)page, 6));
+}
+
+static bool recordValid(eventRecord_t const *record) {
+	return record->crc == crc16((uint8_t const *)record, 6);
+}
+
+static void pageStart(eventPage_t *page, uint32_t seq) {
+	memset(page, 0xFF, sizeof(*page));
+	page->seq = seq;
+	page->magic = EVENTLOG_MAGIC;
+	page->crc = crc16((uint8_t const *)page, 6);
+}
+
+/*
+ * @brief Configure the EEPROM controller for the current CPU clock
+ */
+static void eepromInit(void) {
+	uint32_t mhz = SystemCoreClock / 1000000UL;
+
+	LPC_EEPROM->PWRDWN = 0;                                 /* power up the EEPROM */
+	LPC_EEPROM->CLKDIV = SystemCoreClock / 375000UL - 1UL;  /* 375kHz program clock */
+	LPC_EEPROM->WSTATE = ((mhz * 15UL) / 1000UL + 1UL)      /* wait states for read/write phases */
+	                   | (((mhz * 55UL) / 1000UL + 1UL) << 8)
+	                   | (((mhz * 35UL) / 1000UL + 1UL) << 16);
+}
+
+static void eepromRead(uint8_t page, uint32_t offset, uint32_t *data, uint32_t words) {
+	uint32_t i;
+
+	LPC_EEPROM->INT_CLR_STATUS = EEPROM_END_OF_RDWR;
+	LPC_EEPROM->ADDR = ((uint32_t)page << 6) | offset;
+	LPC_EEPROM->CMD = EEPROM_CMD_READ32 | EEPROM_CMD_RDPREFETCH;
+	for (i = 0; i < words; i++) {
+		data[i] = LPC_EEPROM->RDATA;                        /* address auto-increments */
+		while ((LPC_EEPROM->INT_STATUS & EEPROM_END_OF_RDWR) == 0);
+		LPC_EEPROM->INT_CLR_STATUS = EEPROM_END_OF_RDWR;
+	}
+}
+
+/*
+ * @brief Fill the page latch and program one whole page. Must be called
+ *        from task context: the 3ms program time is spent sleeping.
+ */
+static void eepromProgram(uint8_t page, uint32_t const *data) {
+	uint32_t i;
+
+	LPC_EEPROM->INT_CLR_STATUS = EEPROM_END_OF_RDWR | EEPROM_END_OF_PROG;
+	LPC_EEPROM->ADDR = 0;
+	LPC_EEPROM->CMD = EEPROM_CMD_WRITE32;
+	for (i = 0; i < EVENTLOG_PAGE_SIZE / 4; i++) {
+		LPC_EEPROM->WDATA = data[i];                        /* latch address auto-increments */
+		while ((LPC_EEPROM->INT_STATUS & EEPROM_END_OF_RDWR) == 0);
+		LPC_EEPROM->INT_CLR_STATUS = EEPROM_END_OF_RDWR;
+	}
+	LPC_EEPROM->ADDR = (uint32_t)page << 6;
+	LPC_EEPROM->CMD = EEPROM_CMD_PROG_PAGE;
+	while ((LPC_EEPROM->INT_STATUS & EEPROM_END_OF_PROG) == 0) {
+		OSTimeDly(1);
+	}
+	LPC_EEPROM->INT_CLR_STATUS = EEPROM_END_OF_PROG;
+}
+
+/*
+ * @brief Find the newest page by reading only the page headers, then load
+ *        its records to find where appending continues.
+ */
+void eventLogMount(void) {
+	eventPage_t header;
+	uint32_t newestSeq = 0;
+	bool found = false;
+	uint8_t page;
+	uint8_t i;
+
+	eepromInit();
+	for (page = 0; page < EVENTLOG_PAGES; page++) {
+		eepromRead(page, 0, (uint32_t *)&header, 2);
+		if (headerValid(&header) && (!found || header.seq > newestSeq)) {
+			newestSeq = header.seq;
+			workPage = page;
+			found = true;
+		}
+	}
+
+	validPages = 0;
+	workCount = 0;
+	if (found) {
+		/* count the older pages that still belong to the ring */
+		for (page = 0; page < EVENTLOG_PAGES; page++) {
+			eepromRead(page, 0, (uint32_t *)&header, 2);
+			if (headerValid(&header) && (newestSeq - header.seq) < EVENTLOG_PAGES - 1UL) {
+				validPages++;
+			}
+		}
+		eepromRead(workPage, 0, (uint32_t *)&work, EVENTLOG_PAGE_SIZE / 4);
+		while (workCount < EVENTLOG_RECORDS_PER_PAGE && recordValid(&work.records[workCount])) {
+			workCount++;
+		}
+		for (i = workCount; i < EVENTLOG_RECORDS_PER_PAGE; i++) {
+			memset(&work.records[i], 0xFF, sizeof(eventRecord_t));
+		}
+		if (workCount == EVENTLOG_RECORDS_PER_PAGE) {
+			/* newest page is already full, continue on the next one */
+			workPage = (uint8_t)((workPage + 1U) % EVENTLOG_PAGES);
+			pageStart(&work, newestSeq + 1UL);
+			workCount = 0;
+			if (validPages < EVENTLOG_PAGES - 1U) {
+				validPages++;
+			}
+		}
+	}
+	else {
+		workPage = 0;
+		pageStart(&work, 0);
+		validPages = 1;
+	}
+
+	workDirty = false;
+	pendingValid = false;
+	memset(&stats, 0, sizeof(stats));
+	stats.count = (uint32_t)(validPages - 1U) * EVENTLOG_RECORDS_PER_PAGE + workCount;
+	pageReady = OSSemCreate(0);
+}
+
+/*
+ * @brief Record an event. Never waits for the EEPROM: the record is copied
+ *        into RAM and the page is programmed later by eventLogService().
+ * @result false if the record had to be dropped
+ */
+bool eventLogAppend(uint8_t type, uint8_t arg) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	eventRecord_t record;
+	bool full = false;
+
+	record.timestamp = OSTimeGet();
+	record.type = type;
+	record.arg = arg;
+	record.crc = crc16((uint8_t const *)&record, 6);
+
+	OS_ENTER_CRITICAL();
+	if (workCount == EVENTLOG_RECORDS_PER_PAGE) {
+		/* previous full page still waiting for the log task */
+		stats.dropped++;
+		OS_EXIT_CRITICAL();
+		return false;
+	}
+	work.records[workCount++] = record;
+	workDirty = true;
+	stats.appended++;
+	if (stats.count < EVENTLOG_CAPACITY) {
+		stats.count++;
+	}
+	if (workCount == EVENTLOG_RECORDS_PER_PAGE && !pendingValid) {
+		pending = work;
+		pendingPage = workPage;
+		pendingValid = true;
+		workPage = (uint8_t)((workPage + 1U) % EVENTLOG_PAGES);
+		pageStart(&work, pending.seq + 1UL);
+		workCount = 0;
+		workDirty = false;
+		if (validPages < EVENTLOG_PAGES - 1U) {
+			validPages++;
+		}
+		full = true;
+	}
+	OS_EXIT_CRITICAL();
+
+	if (full) {
+		OSSemPost(pageReady);
+	}
+	return true;
+}
+
+/*
+ * @brief Block the log task until a full page is waiting or timeout ticks
+ *        have passed.
+ * @result true if a full page is waiting
+ */
+bool eventLogWait(uint32_t timeout) {
+	uint8_t err;
+
+	OSSemPend(pageReady, timeout, &err);
+	return err == OS_ERR_NONE;
+}
+
+/*
+ * @brief Program the waiting full page, then the partially filled page if
+ *        it holds records that are not in the EEPROM yet.
+ */
+void eventLogService(void) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	eventPage_t snapshot;
+	uint8_t page;
+	bool dirty;
+
+	if (pendingValid) {
+		eepromProgram(pendingPage, (uint32_t const *)&pending);
+		stats.pagesWritten++;
+
+		OS_ENTER_CRITICAL();
+		pendingValid = false;
+		if (workCount == EVENTLOG_RECORDS_PER_PAGE) {
+			/* work filled up while pending was being written */
+			pending = work;
+			pendingPage = workPage;
+			pendingValid = true;
+			workPage = (uint8_t)((workPage + 1U) % EVENTLOG_PAGES);
+			pageStart(&work, pending.seq + 1UL);
+			workCount = 0;
+			workDirty = false;
+		}
+		OS_EXIT_CRITICAL();
+		if (pendingValid) {
+			OSSemPost(pageReady);
+			return;
+		}
+	}
+
+	OS_ENTER_CRITICAL();
+	dirty = workDirty;
+	snapshot = work;
+	page = workPage;
+	workDirty = false;
+	OS_EXIT_CRITICAL();
+
+	if (dirty) {
+		eepromProgram(page, (uint32_t const *)&snapshot);
+		stats.pagesWritten++;
+	}
+}
+
+/*
+ * @brief Read back a record. Call from the log task so that reads never
+ *        overlap a page program.
+ * @param age - 0 for the newest record, 1 for the one before, ...
+ * @result false if the log holds fewer than age + 1 records
+ */
+bool eventLogRead(uint32_t age, eventRecord_t *record) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	eventPage_t header;
+	uint32_t seq;
+	uint32_t back;
+	uint8_t page;
+	uint8_t slot;
+
+	OS_ENTER_CRITICAL();
+	if (age < workCount) {
+		*record = work.records[workCount - 1U - age];
+		OS_EXIT_CRITICAL();
+		return true;
+	}
+	age -= workCount;
+	seq = work.seq;
+	page = workPage;
+	if (pendingValid) {
+		if (age < EVENTLOG_RECORDS_PER_PAGE) {
+			*record = pending.records[EVENTLOG_RECORDS_PER_PAGE - 1U - age];
+			OS_EXIT_CRITICAL();
+			return true;
+		}
+		age -= EVENTLOG_RECORDS_PER_PAGE;
+		seq = pending.seq;
+		page = pendingPage;
+	}
+	OS_EXIT_CRITICAL();
+
+	back = age / EVENTLOG_RECORDS_PER_PAGE + 1UL;
+	slot = (uint8_t)(EVENTLOG_RECORDS_PER_PAGE - 1U - age % EVENTLOG_RECORDS_PER_PAGE);
+	if (back >= EVENTLOG_PAGES - 1UL || back > seq) {
+		return false;
+	}
+	page = (uint8_t)((page + EVENTLOG_PAGES - back) % EVENTLOG_PAGES);
+	eepromRead(page, 0, (uint32_t *)&header, 2);
+	if (!headerValid(&header) || header.seq != seq - back) {
+		return false;
+	}
+	eepromRead(page, 8UL + slot * sizeof(eventRecord_t), (uint32_t *)record, sizeof(eventRecord_t) / 4);
+	return recordValid(record);
+}
+
+void eventLogGetStats(eventLogStats_t *out) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	OS_ENTER_CRITICAL();
+	*out = stats;
+	OS_EXIT_CRITICAL();
+}
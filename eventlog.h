@@ -0,0 +1,49 @@
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Append-only event log kept in the on-chip EEPROM. Records are collected
+ * in a RAM page image and written a whole page at a time, rotating through
+ * every EEPROM page so the wear is spread evenly.
+ */
+
+enum {
+	EVENTLOG_PAGE_SIZE        = 64UL,  /* bytes in one EEPROM page */
+	EVENTLOG_PAGES            = 63UL,  /* 4032 bytes of EEPROM are usable */
+	EVENTLOG_RECORDS_PER_PAGE = 7UL,   /* one 8 byte header + 7 records */
+	EVENTLOG_CAPACITY         = (EVENTLOG_PAGES - 1UL) * EVENTLOG_RECORDS_PER_PAGE
+};
+
+typedef struct {
+	uint32_t timestamp;  /* OS tick at which the event was recorded */
+	uint8_t type;
+	uint8_t arg;
+	uint16_t crc;        /* CRC-16/CCITT over the preceding six bytes */
+} eventRecord_t;
+
+typedef struct {
+	uint32_t appended;   /* records accepted since mount */
+	uint32_t dropped;    /* records lost because no page image was free */
+	uint32_t pagesWritten;
+	uint32_t count;      /* valid records currently held by the log */
+} eventLogStats_t;
+
+void eventLogMount(void);
+bool eventLogAppend(uint8_t type, uint8_t arg);
+bool eventLogWait(uint32_t timeout);
+void eventLogService(void);
+bool eventLogRead(uint32_t age, eventRecord_t *record);
+void eventLogGetStats(eventLogStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef __GPIO_H__
+#define __GPIO_H__
+
+#include <stdint.h>
+#include <LPC407x_8x_177x_8x.h>
+
+/*
+ * Compile-time GPIO. The port and the pins are template parameters, so
+ * every call inlines to a single load or store on the port's PIN, SET or
+ * CLR register at a constant address.
+ */
+
+template <uint32_t Port, uint32_t Mask>
+struct GpioGroup {
+	static LPC_GPIO_TypeDef *regs() {
+		return reinterpret_cast<LPC_GPIO_TypeDef *>(LPC_GPIO0_BASE + Port * 0x20UL);
+	}
+	static void input()  { regs()->DIR &= ~Mask; }
+	static void output() { regs()->DIR |= Mask; }
+
+	/* the group's pins, in their port positions */
+	static uint32_t read() { return regs()->PIN & Mask; }
+	static void set()      { regs()->SET = Mask; }
+	static void clear()    { regs()->CLR = Mask; }
+
+	/* one read, then SET and CLR so no other pin of the port is touched */
+	static void toggle() {
+		uint32_t on = regs()->PIN & Mask;
+		regs()->SET = ~on & Mask;
+		regs()->CLR = on;
+	}
+};
+
+template <uint32_t Port, uint32_t Pin>
+struct GpioPin : GpioGroup<Port, (1UL << Pin)> {
+	static bool isHigh() { return GpioGroup<Port, (1UL << Pin)>::read() != 0; }
+	static void write(bool high) {
+		if (high) GpioGroup<Port, (1UL << Pin)>::set();
+		else GpioGroup<Port, (1UL << Pin)>::clear();
+	}
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include <LPC407x_8x_177x_8x.h>
+#include <ucos_ii.h>
+#include "i2cqueue.h"
+
+enum {
+	I2C_AA   = 0x04UL,   /* assert acknowledge */
+	I2C_SI   = 0x08UL,   /* interrupt flag */
+	I2C_STO  = 0x10UL,   /* stop */
+	I2C_STA  = 0x20UL,   /* start */
+	I2C_I2EN = 0x40UL    /* interface enable */
+};
+
+static i2cTransaction_t *head;   /* transaction on the bus */
+static i2cTransaction_t *tail;
+static uint8_t count;            /* bytes of head moved so far */
+
+static void start(void) {
+	count = 0;
+	LPC_I2C0->CONSET = I2C_STA;
+}
+
+/*
+ * @brief Finish the transaction on the bus and start the next queued one.
+ *        Called from the interrupt.
+ */
+static void complete(i2cResult_t result) {
+	i2cTransaction_t *t = head;
+
+	LPC_I2C0->CONSET = I2C_STO;
+	head = t->next;
+	if (head == 0) {
+		tail = 0;
+	}
+	t->result = result;
+	if (t->done != 0) {
+		OSSemPost(t->done);
+	}
+	if (head != 0) {
+		start();                   /* START goes out once the STOP has */
+	}
+}
+
+/*
+ * @brief Configure I2C0 as a master
+ * @param hz - bus clock, 100000 or 400000
+ */
+void i2cQueueInit(uint32_t hz) {
+	LPC_SC->PCONP |= (1UL << 7);                                /* ensure power to I2C0 */
+	LPC_IOCON->P0_27 = (LPC_IOCON->P0_27 & ~0x07UL) | 0x01UL;   /* SDA0 */
+	LPC_IOCON->P0_28 = (LPC_IOCON->P0_28 & ~0x07UL) | 0x01UL;   /* SCL0 */
+	LPC_I2C0->CONCLR = I2C_AA | I2C_SI | I2C_STA | I2C_I2EN;
+	LPC_I2C0->SCLH = PeripheralClock / (2UL * hz);
+	LPC_I2C0->SCLL = PeripheralClock / (2UL * hz);
+	head = 0;
+	tail = 0;
+	LPC_I2C0->CONSET = I2C_I2EN;
+	NVIC_EnableIRQ(I2C0_IRQn);
+}
+
+/*
+ * @brief Abort every queued transaction with I2C_ERROR, send a STOP and
+ *        restart the interface. For a bus that stopped raising interrupts.
+ */
+void i2cReset(void) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	i2cTransaction_t *t;
+
+	OS_ENTER_CRITICAL();
+	t = head;
+	head = 0;
+	tail = 0;
+	LPC_I2C0->CONSET = I2C_STO;
+	LPC_I2C0->CONCLR = I2C_AA | I2C_SI | I2C_STA | I2C_I2EN;
+	LPC_I2C0->CONSET = I2C_I2EN;
+	while (t != 0) {
+		i2cTransaction_t *next = t->next;
+		t->result = I2C_ERROR;
+		if (t->done != 0) {
+			OSSemPost(t->done);
+		}
+		t = next;
+	}
+	OS_EXIT_CRITICAL();
+}
+
+/*
+ * @brief Queue a transaction and return at once. t must stay valid until
+ *        its result is no longer I2C_PENDING.
+ */
+void i2cSubmit(i2cTransaction_t *t) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	t->result = I2C_PENDING;
+	t->next = 0;
+	OS_ENTER_CRITICAL();
+	if (tail != 0) {
+		tail->next = t;
+		tail = t;
+	}
+	else {
+		head = t;
+		tail = t;
+		start();
+	}
+	OS_EXIT_CRITICAL();
+}
+
+void I2C0_IRQHandler(void) {
+	i2cTransaction_t *t = head;
+
+	OSIntEnter();
+	switch (LPC_I2C0->STAT) {
+		case 0x08:                                  /* START sent: address for writing */
+			LPC_I2C0->DAT = (uint32_t)t->address << 1;
+			LPC_I2C0->CONCLR = I2C_STA;
+			break;
+		case 0x10:                                  /* repeated START sent: address for reading */
+			LPC_I2C0->DAT = ((uint32_t)t->address << 1) | 1UL;
+			LPC_I2C0->CONCLR = I2C_STA;
+			break;
+		case 0x18:                                  /* SLA+W acked: register address */
+			LPC_I2C0->DAT = t->reg;
+			break;
+		case 0x28:                                  /* byte acked */
+			if (t->write && count < t->length) {
+				LPC_I2C0->DAT = t->data[count++];
+			}
+			else if (t->write || t->length == 0) {
+				complete(I2C_DONE);
+			}
+			else {
+				LPC_I2C0->CONSET = I2C_STA;         /* turn the bus round for reading */
+			}
+			break;
+		case 0x40:                                  /* SLA+R acked */
+			if (t->length > 1) LPC_I2C0->CONSET = I2C_AA;
+			else LPC_I2C0->CONCLR = I2C_AA;          /* nack the only byte */
+			break;
+		case 0x50:                                  /* byte received, acked */
+			t->data[count++] = (uint8_t)LPC_I2C0->DAT;
+			if (count + 1U < t->length) LPC_I2C0->CONSET = I2C_AA;
+			else LPC_I2C0->CONCLR = I2C_AA;          /* nack the last byte */
+			break;
+		case 0x58:                                  /* last byte received, nacked */
+			t->data[count++] = (uint8_t)LPC_I2C0->DAT;
+			complete(I2C_DONE);
+			break;
+		default:                                    /* nack or arbitration lost */
+			if (t != 0) {
+				complete(I2C_ERROR);
+			}
+			else {
+				LPC_I2C0->CONSET = I2C_STO;
+			}
+			break;
+	}
+	LPC_I2C0->CONCLR = I2C_SI;
+	OSIntExit();
+}
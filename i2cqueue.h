@@ -0,0 +1,43 @@
+#ifndef __I2CQUEUE_H__
+#define __I2CQUEUE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <ucos_ii.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Interrupt-driven I2C0 master (SDA0 P0.27, SCL0 P0.28). Transactions are
+ * queued and run one after the other from the I2C0 interrupt; the caller
+ * carries on and is told about the result through a semaphore.
+ */
+
+typedef enum {
+	I2C_PENDING = 0,
+	I2C_DONE,
+	I2C_ERROR
+} i2cResult_t;
+
+typedef struct i2cTransaction {
+	uint8_t address;                  /* 7-bit slave address */
+	uint8_t reg;                      /* first register, sent before the data */
+	bool write;                       /* write data to the slave, else read into it */
+	uint8_t length;
+	uint8_t *data;
+	OS_EVENT *done;                   /* posted on completion, may be 0 */
+	volatile i2cResult_t result;
+	struct i2cTransaction *next;      /* owned by the queue while pending */
+} i2cTransaction_t;
+
+void i2cQueueInit(uint32_t hz);
+void i2cSubmit(i2cTransaction_t *t);
+void i2cReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
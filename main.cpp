@@ -9,46 +9,105 @@
 #include <display.h>
 #include <MMA7455.h>
 #include "buffer.h"
+#include "eventlog.h"
+#include "telemetry.h"
+#include "tickless.h"
+#include "timer.h"
+#include "gpio.h"
+#include "i2cqueue.h"
+#include "motion.h"
+#include "taskmon.h"
 
 /********************************************************************************************************
-*                                            APPLICATION TASK PRIORITIES
+*                                            APPLICATION TASK PROTOTYPES
 ********************************************************************************************************/
 
-typedef enum {
-	APP_TASK_BUTTONS_PRIO = 4,
-	APP_TASK_LCD_PRIO,
-	APP_TASK_POT_PRIO,
-	APP_TASK_ACC_PRIO,
-  	APP_TASK_LED_PRIO
-} taskPriorities_t;
+static void appTaskButtons(void *pdata);
+static void appTaskPot(void *pdata);
+static void appTaskAcc(void *pdata);
+static void appTaskLcd(void *pdata);
+static void appTaskLed(void *pdata);
+static void appTaskTelemetry(void *pdata);
+static void appTaskLog(void *pdata);
+
 
 /********************************************************************************************************
-*                                            APPLICATION TASK STACKS
+*                                            APPLICATION TASK CONFIGURATION
 ********************************************************************************************************/
 
-#define  APP_TASK_BUTTONS_STK_SIZE           256
-#define  APP_TASK_POT_STK_SIZE               256
-#define  APP_TASK_ACC_STK_SIZE               256
-#define  APP_TASK_LCD_STK_SIZE               256
-#define  APP_TASK_LED_STK_SIZE               256
+// Tasks, stacks and queues are all declared here. Everything below is generated from these tables
+// and checked at compile time: a task is one row in appTasks, a queue one row in appQueues plus
+// its queueId_t.
 
+typedef struct {
+	void (*entry)(void *pdata);
+	uint8_t prio;
+	uint16_t stackSize;       // OS_STK entries
+} taskConfig_t;
 
-static OS_STK appTaskButtonsStk[APP_TASK_BUTTONS_STK_SIZE];
-static OS_STK appTaskPotStk[APP_TASK_POT_STK_SIZE];
-static OS_STK appTaskAccStk[APP_TASK_ACC_STK_SIZE];
-static OS_STK appTaskLcdStk[APP_TASK_LCD_STK_SIZE];
-static OS_STK appTaskLedStk[APP_TASK_LED_STK_SIZE];
+typedef struct {
+	uint8_t capacity;         // messages
+} queueConfig_t;
 
+static constexpr taskConfig_t appTasks[] = {
+	// entry             prio  stack
+	{ appTaskButtons,      4,   256 },   // highest priority task starts the OS tick
+	{ appTaskLcd,          5,   256 },
+	{ appTaskPot,          6,   256 },
+	{ appTaskAcc,          7,   256 },
+	{ appTaskLed,          8,   256 },
+	{ appTaskTelemetry,    9,   256 },
+	{ appTaskLog,         10,   256 }
+};
 
-/********************************************************************************************************
-*                                            APPLICATION TASK PROTOTYPES
-********************************************************************************************************/
+typedef enum {
+	Q_LCD = 0,
+	Q_COUNT
+} queueId_t;
 
-static void appTaskButtons(void *pdata);
-static void appTaskPot(void *pdata);
-static void appTaskAcc(void *pdata);
-static void appTaskLcd(void *pdata);
-static void appTaskLed(void *pdata);
+static constexpr queueConfig_t appQueues[] = {
+	// capacity
+	{ 4 }                               // Q_LCD
+};
+
+static constexpr uint32_t APP_TASK_COUNT  = sizeof(appTasks) / sizeof(appTasks[0]);
+static constexpr uint32_t APP_QUEUE_COUNT = sizeof(appQueues) / sizeof(appQueues[0]);
+static constexpr uint32_t APP_RAM_BUDGET  = 16 * 1024;   // bytes for task stacks and queue storage
+
+static constexpr uint32_t stackOffset(uint32_t task) {
+	return task == 0 ? 0 : stackOffset(task - 1) + appTasks[task - 1].stackSize;
+}
+
+static constexpr uint32_t queueOffset(uint32_t queue) {
+	return queue == 0 ? 0 : queueOffset(queue - 1) + appQueues[queue - 1].capacity;
+}
+
+static constexpr bool prioTaken(uint32_t task, uint32_t other) {
+	return other >= APP_TASK_COUNT ? false
+	     : (appTasks[task].prio == appTasks[other].prio || prioTaken(task, other + 1));
+}
+
+static constexpr bool priosValid(uint32_t task) {
+	return task >= APP_TASK_COUNT ? true
+	     : (appTasks[task].prio >= 4 && appTasks[task].prio < OS_LOWEST_PRIO - 1 &&
+	        !prioTaken(task, task + 1) && priosValid(task + 1));
+}
+
+static constexpr uint32_t APP_STACK_WORDS = stackOffset(APP_TASK_COUNT);
+static constexpr uint32_t APP_STACK_BYTES = APP_STACK_WORDS * sizeof(OS_STK);
+static constexpr uint32_t APP_QUEUE_SLOTS = queueOffset(APP_QUEUE_COUNT);
+static constexpr uint32_t APP_QUEUE_BYTES = APP_QUEUE_SLOTS * sizeof(message_t);
+
+static_assert(Q_COUNT == APP_QUEUE_COUNT, "every queueId_t needs a row in appQueues");
+static_assert(priosValid(0), "task priorities must be unique, above 3 and below the idle/stat tasks");
+static_assert(APP_STACK_BYTES + APP_QUEUE_BYTES <= APP_RAM_BUDGET, "tasks and queues exceed APP_RAM_BUDGET");
+
+// Footprint summary, sent once at start-up as a TLM_FOOTPRINT record
+static const telemetryFootprint_t appFootprint = {
+	APP_TASK_COUNT, APP_QUEUE_COUNT, 0, APP_STACK_BYTES, APP_QUEUE_BYTES, APP_RAM_BUDGET
+};
+
+static OS_STK appTaskStk[APP_STACK_WORDS];
 
 
 /********************************************************************************************************
@@ -81,9 +140,64 @@ typedef enum messageTypes {
   	M_POSITION,
 	M_DISPLAY_CLEAR,
 	M_PIN_EDIT_ON,
-	M_PIN_EDIT_OFF
+	M_PIN_EDIT_OFF,
+	M_PIN_FAILED,
+	M_ACC_BUS_RESET
 } messageType_t;
 
+// Response time monitor ids and deadlines
+typedef enum {
+	TM_BUTTONS = 0,   // debounced press to its row drawn on the LCD, without the debounce delay
+	TM_COUNTDOWN,     // jitter of the 1s countdown tick
+	TM_ACC,           // first excursion to M_ALARM_PENDING
+	TM_LCD,           // drawing one frame
+	TM_LED            // one LED toggle
+} taskMonId_t;
+
+enum {
+	TM_BUTTONS_DEADLINE_US   = 50000,
+	TM_COUNTDOWN_DEADLINE_US = 10000,
+	TM_ACC_DEADLINE_US       = 200000,
+	TM_LCD_DEADLINE_US       = 33000,
+	TM_LED_DEADLINE_US       = 1000,
+	COUNTDOWN_PERIOD_US      = 1000000
+};
+
+// State change flags, one per task that waits for a state it can act on
+enum {
+	APP_FLAG_POT = (1U << 0),
+	APP_FLAG_ACC = (1U << 1),
+	APP_FLAG_LED = (1U << 2),
+	APP_FLAG_ALL = APP_FLAG_POT | APP_FLAG_ACC | APP_FLAG_LED
+};
+
+enum {
+	LOG_FLUSH_DELAY = 5000  // ticks before a partly filled log page is written
+};
+
+enum {
+	TELEMETRY_BAUD          = 115200,
+	TELEMETRY_PERIOD        = 100,  // ms a batch collects records before it is sent
+	TELEMETRY_REPORT_TICKS  = OS_TICKS_PER_SEC, // counter, power, OS and taskmon records once a second
+	ACC_SUMMARY_SAMPLES     = 100   // accelerometer samples per summary
+};
+
+enum {
+	ACC_I2C_ADDRESS   = 0x1D,    // MMA7455
+	ACC_REG_XOUT8     = 0x06,    // XOUT8, YOUT8, ZOUT8 follow each other
+	ACC_I2C_HZ        = 400000,
+	ACC_SAMPLE_PERIOD = 10,      // ms, 100Hz
+	ACC_I2C_TIMEOUT   = 5,       // ticks
+	ACC_I2C_STALLS    = 10,      // sample periods a timed-out read may stay queued before the bus is reset
+	ACC_DECIDE_WINDOWS = 3       // motion windows an excursion waits for a "carried" verdict
+};
+
+enum {
+	LCD_FRAME_US        = 33333,   // 30Hz at most
+	LCD_FRAME_BUDGET_US = 20000,   // cosmetic rows wait for the next frame once a frame takes this long
+	LCD_REPORT_US       = 1000000  // frame statistics window
+};
+
 enum {
 	FLASH_MIN_DELAY     = 1,
 	FLASH_INITIAL_DELAY = 500,
@@ -91,57 +205,163 @@ enum {
 	FLASH_DELAY_STEP    = 50
 };
 
+// Display rows, drawn in this order. Rows from UI_FIRST_COSMETIC on are skipped
+// when a frame runs over LCD_FRAME_BUDGET_US.
+typedef enum {
+	UI_ALARM = 0,
+	UI_TIME,
+	UI_CASE,
+	UI_MOVING,
+	UI_SECURITY,
+	UI_CODE,
+	UI_INTERVAL,
+	UI_POSITION,
+	UI_EDIT,
+	UI_ROWS,
+	UI_FIRST_COSMETIC = UI_INTERVAL
+} uiRow_t;
+
+/*
+ * @brief What the display should show. The LCD task folds every message
+ *        into it and only draws the rows that changed, at most once per
+ *        frame, however fast the messages arrive.
+ */
+typedef struct {
+	uint8_t value[UI_ROWS][4];       // message type or data bytes, depending on the row
+	uint16_t dirty;                  // one bit per row not yet drawn
+	uint32_t dirtyUs[UI_ROWS];       // when the oldest undrawn change of a row was posted
+	uint32_t postedUs;               // posting time of the message being folded
+	uint8_t monitor;                 // taskmon id of the message being folded
+	uint8_t rowMonitor[UI_ROWS];     // taskmon id to record once the row is drawn, or TASKMON_NONE
+	uint32_t rowMonitorUs[UI_ROWS];
+	uint32_t frameUs;                // start of the last frame
+
+	// Statistics for the current LCD_REPORT_US window
+	uint32_t windowUs;
+	uint16_t frames;
+	uint16_t dropped;                // cosmetic rows put off to the next frame
+	uint32_t frameSumUs;
+	uint32_t lagSumUs;
+	uint32_t lagMaxUs;
+	uint16_t lagCount;
+} ui_t;
+
 // States
 typedef enum { LOCKED, UNLOCKED, MOVING } briefcaseStates;
 typedef enum { ENABLED, DISABLED, } securityStates;
 typedef enum { ON, OFF, PENDING } alarmStates;
 typedef enum { ACTIVE, INACTIVE } pinEditModes;
 
-static briefcaseStates briefcaseState;
-static securityStates securityState;
-static alarmStates alarmState;
-static pinEditModes pinEditMode;
+/*
+ * @brief Everything one copy of the application owns. The tasks receive a
+ *        pointer to their instance through pdata, so no application state
+ *        lives in file-static globals.
+ *
+ *        Only one instance is created. The drivers and services behind it
+ *        stay single-copy because they own one piece of hardware or one
+ *        system-wide table each: timer, i2cqueue, telemetry (UART0 and DMA
+ *        channel 0), eventlog (the EEPROM), tickless (SysTick) and taskmon.
+ *        A second instance would share those.
+ */
+typedef struct app {
+	// States
+	briefcaseStates briefcaseState;
+	securityStates securityState;
+	alarmStates alarmState;
+	pinEditModes pinEditMode;
+
+	// Variables
+	int32_t flashingDelay;
+	int32_t accVal[3];
+	float potVal;
+	uint8_t intVal;
+	uint8_t ALARM_INTERVAL;
+
+	// Arrays and Index
+	uint8_t positionArray[4];
+	uint8_t dPinArray[4];
+	uint8_t sPinArray[4];
+	uint8_t index;
+
+	// Accelerometer summary for the telemetry
+	int8_t accMin[3];
+	int8_t accMax[3];
+	uint8_t accSamples;
+
+	// Accelerometer burst read
+	i2cTransaction_t accXfer;
+	uint8_t accRaw[3];
+	uint8_t accStalls;        // sample periods the last read has been stuck on the bus
+	uint8_t accBusResets;     // saturates at 255
+
+	// Carried or bumped
+	motion_t motion;
+	uint8_t motionSuspect;    // windows left to confirm an excursion
+	uint8_t motionAxis;       // axis of the last excursion
+	uint32_t excursionUs;     // first excursion of the current suspicion
+
+	// Response time of the last joystick press
+	uint32_t buttonPressUs;
+	bool buttonPressed;
+
+	// Next response time histogram to report
+	uint8_t taskMonNext;
+
+	// Countdown tick jitter
+	uint32_t countdownUs;     // time of the previous tick
+	bool countdownRunning;
+
+	// Message queues, generated from appQueues
+	message_t queueSlots[APP_QUEUE_SLOTS];   // one pool, split by queueOffset()
+	buffer_t queues[APP_QUEUE_COUNT];        // indexed by queueId_t
+	ui_t ui;
+
+	// Wakes the tasks that sleep until the state changes
+	OS_FLAG_GRP *stateFlags;
+} app_t;
+
+static app_t app;
 
 // Inputs
-static DigitalIn buttons[] = {P5_0, P5_4, P5_2, P5_1, P5_3}; // LEFT, RIGHT, UP, DOWN, CENTER
+typedef GpioGroup<5, 0x1FUL> joystick;                       // P5_0 .. P5_4, read in one access
+static const uint8_t buttonPins[] = {0, 4, 2, 1, 3};         // LEFT, RIGHT, UP, DOWN, CENTER
 static AnalogIn potentiometer(P0_23);
 MMA7455 acc(P0_27, P0_28);  //Object to manage the accelerometer
 
 // Outputs
 static Display *d = Display::theDisplay();
-static DigitalOut led1(P1_18);
-static DigitalOut led2(P0_13);
-static DigitalOut led3(P1_13);
-static DigitalOut led4(P2_19);
-
-// Variables
-static int32_t flashingDelay = FLASH_INITIAL_DELAY;  
-static int32_t accVal[3];
-static float potVal;
-static uint8_t intVal;
-static uint8_t ALARM_INTERVAL = 10;
-
-// Arrays and Index
-uint8_t positionArray[4] = {'-', ' ', ' ', ' '};
-uint8_t dPinArray[4] = {'0','0','0','0'};
-uint8_t sPinArray[4] = {'1','0','0','0'};
-uint8_t index = 0;
+typedef GpioGroup<1, (1UL << 18) | (1UL << 13)> ledsPort1;  // led1 P1_18, led3 P1_13
+typedef GpioPin<0, 13> led2;
+typedef GpioPin<2, 19> led4;
 
 /********************************************************************************************************
 *                                            APPLICATION FUNCTION PROTOTYPES
 ********************************************************************************************************/
 
-static bool buttonPressedAndReleased(buttonId_t button);
+static bool buttonPressedAndReleased(app_t *a, buttonId_t button);
 //static void incDigit(uint8_t* pinArray);
 //static void decDigit(uint8_t* pinArray);
 bool accInit(MMA7455& acc); //prototype of init routine
-bool provePin();
-void displayInit(void);
-void statesInit(void);
-void dPinArrayInit(void);
-void dPinArrayClear(void);
-void positionArrayInit(void);
-void positionArrayClear(void);
+void gpioInit(void);
+bool provePin(app_t *a);
+void appInit(app_t *a);
+void displayInit(app_t *a);
+void statesInit(app_t *a);
+void dPinArrayInit(app_t *a);
+void dPinArrayClear(app_t *a);
+void positionArrayInit(app_t *a);
+void positionArrayClear(app_t *a);
+void accSummaryAdd(app_t *a);
+bool accRead(app_t *a);
+void stateChanged(app_t *a);
+void telemetryPostCounters(app_t *a);
+void taskMonSetup(void);
+void waitForStateChange(app_t *a, OS_FLAGS flag);
+void buttonPost(app_t *a, message_t const *msg);
+bool uiSet(ui_t *ui, uiRow_t row, uint8_t v0, uint8_t v1, uint8_t v2, uint8_t v3);
+void uiFold(ui_t *ui, message_t const *msg);
+void uiDrawFrame(ui_t *ui);
+void uiDrawRow(ui_t const *ui, uiRow_t row);
 
 /********************************************************************************************************
 *                                            GLOBAL FUNCTION DEFINITIONS
@@ -152,36 +372,29 @@ int main() {
   /* Initialise the OS */
   OSInit();
 
+  /* Initialise the application instance */
+  appInit(&app);
+
   /* Create the tasks */
-  OSTaskCreate(appTaskButtons,                               
-               (void *)0,
-               (OS_STK *)&appTaskButtonsStk[APP_TASK_BUTTONS_STK_SIZE - 1],
-               APP_TASK_BUTTONS_PRIO);
-  
-  OSTaskCreate(appTaskPot,                               
-               (void *)0,
-               (OS_STK *)&appTaskPotStk[APP_TASK_POT_STK_SIZE - 1],
-               APP_TASK_POT_PRIO);
-							 
-  OSTaskCreate(appTaskAcc,                               
-               (void *)0,
-               (OS_STK *)&appTaskAccStk[APP_TASK_ACC_STK_SIZE - 1],
-               APP_TASK_ACC_PRIO);
-							 
-	OSTaskCreate(appTaskLcd,                               
-               (void *)0,
-               (OS_STK *)&appTaskLcdStk[APP_TASK_LCD_STK_SIZE - 1],
-               APP_TASK_LCD_PRIO);
-
-	OSTaskCreate(appTaskLed,                               
-               (void *)0,
-               (OS_STK *)&appTaskLedStk[APP_TASK_LED_STK_SIZE - 1],
-               APP_TASK_LED_PRIO);
+  for (uint32_t i = 0; i < APP_TASK_COUNT; i++) {
+    OSTaskCreate(appTasks[i].entry,
+                 (void *)&app,
+                 (OS_STK *)&appTaskStk[stackOffset(i) + appTasks[i].stackSize - 1],
+                 appTasks[i].prio);
+  }
 	
-	// Initialise the buffer
-	bufferSaveInit();
-	// Initialise accelerometer
+	// Start the microsecond timebase and the response time monitor
+	usTimerInit();
+	taskMonSetup();
+	// Recover the event log
+	eventLogMount();
+	// Initialise the telemetry link
+	telemetryInit(TELEMETRY_BAUD);
+	// Initialise joystick and LEDs
+	gpioInit();
+	// Initialise accelerometer, then take over its bus for interrupt-driven reads
 	accInit(acc);
+	i2cQueueInit(ACC_I2C_HZ);
   
   /* Start the OS */
   OSStart();                                                  
@@ -201,278 +414,293 @@ static void appTaskButtons(void *pdata)
 {
   /* Start the OS ticker -- must be done in the highest priority task */
   SysTick_Config(SystemCoreClock / OS_TICKS_PER_SEC); 
-	statesInit();
-	displayInit();
-	
+	ticklessInit(OS_TICKS_PER_SEC);
+	app_t *a = (app_t *)pdata;
 	message_t msg;
 	
+	statesInit(a);
+	displayInit(a);
+	
   /* Task main loop */
   while (true) 
 	{
 		//---------------------------------------------------------------------------------------------
 		// lock briefcase
-			if 	(buttonPressedAndReleased(JUP) &&
-				(briefcaseState == UNLOCKED) &&
-				(securityState == DISABLED) &&
-				(alarmState == OFF) &&
-				(pinEditMode == INACTIVE) ) 
+			if 	(buttonPressedAndReleased(a, JUP) &&
+				(a->briefcaseState == UNLOCKED) &&
+				(a->securityState == DISABLED) &&
+				(a->alarmState == OFF) &&
+				(a->pinEditMode == INACTIVE) ) 
 		{
-			briefcaseState = LOCKED;
+			a->briefcaseState = LOCKED;
 			msg.taskId = M_BRIEFCASE_LOCKED;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
+			stateChanged(a);
 		}		
 		// unlock briefcase
-		else if 	(buttonPressedAndReleased(JDOWN) &&
-				(briefcaseState == LOCKED) &&
-				(securityState == DISABLED) &&
-				(alarmState == OFF) &&
-				(pinEditMode == INACTIVE) )
+		else if 	(buttonPressedAndReleased(a, JDOWN) &&
+				(a->briefcaseState == LOCKED) &&
+				(a->securityState == DISABLED) &&
+				(a->alarmState == OFF) &&
+				(a->pinEditMode == INACTIVE) )
 		{
-			briefcaseState = UNLOCKED;
+			a->briefcaseState = UNLOCKED;
 			msg.taskId = M_BRIEFCASE_UNLOCKED;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
+			stateChanged(a);
 		}
 		//---------------------------------------------------------------------------------------------		
 		// enable security
-    else if (buttonPressedAndReleased(JRIGHT) && 
-						(briefcaseState == LOCKED) &&
-						(securityState == DISABLED) &&
-						(alarmState == OFF) &&
-						(pinEditMode == INACTIVE) )
+    else if (buttonPressedAndReleased(a, JRIGHT) && 
+						(a->briefcaseState == LOCKED) &&
+						(a->securityState == DISABLED) &&
+						(a->alarmState == OFF) &&
+						(a->pinEditMode == INACTIVE) )
 		{
-			securityState = ENABLED;
+			a->securityState = ENABLED;
 			msg.taskId = M_SECURITY_ENABELD;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
+			eventLogAppend(M_SECURITY_ENABELD, 0);
+			stateChanged(a);
 		
-			dPinArrayInit();
+			dPinArrayInit(a);
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = dPinArray[0];
-			msg.dataArray[1] = dPinArray[1];
-			msg.dataArray[2] = dPinArray[2];
-			msg.dataArray[3] = dPinArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->dPinArray[0];
+			msg.dataArray[1] = a->dPinArray[1];
+			msg.dataArray[2] = a->dPinArray[2];
+			msg.dataArray[3] = a->dPinArray[3];
+			buttonPost(a, &msg);
 		
-			positionArrayInit();
+			positionArrayInit(a);
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);				
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);				
 		}
 		// disable security 
-		else if (buttonPressedAndReleased(JCENTER) && 
-						(briefcaseState == LOCKED || MOVING) && 
-						(securityState == ENABLED) &&
-						(alarmState == OFF || PENDING || ON ) && 
-						(pinEditMode == INACTIVE)	)
+		else if (buttonPressedAndReleased(a, JCENTER) && 
+						(a->briefcaseState == LOCKED || MOVING) && 
+						(a->securityState == ENABLED) &&
+						(a->alarmState == OFF || PENDING || ON ) && 
+						(a->pinEditMode == INACTIVE)	)
 		{	
-			if (provePin())
+			if (provePin(a))
 			{
-				briefcaseState = LOCKED;
+				a->briefcaseState = LOCKED;
 				msg.taskId = M_BRIEFCASE_LOCKED;
-				putBufferSave(&msg);
+				buttonPost(a, &msg);
 			
-				securityState = DISABLED;
+				a->securityState = DISABLED;
 				msg.taskId = M_SECURITY_DISABLED;
-				putBufferSave(&msg);
+				buttonPost(a, &msg);
+				eventLogAppend(M_SECURITY_DISABLED, 0);
 			
-				alarmState = OFF;
+				a->alarmState = OFF;
 				msg.taskId = M_ALARM_OFF;
-				putBufferSave(&msg);
+				buttonPost(a, &msg);
+				stateChanged(a);
 						
 				msg.taskId = M_DISPLAY_CLEAR;
-				putBufferSave(&msg);
+				buttonPost(a, &msg);
+			}
+			else
+			{
+				eventLogAppend(M_PIN_FAILED, 0);
 			}
 		}
 		
 		// increase dispayedPin digit
-		else if (buttonPressedAndReleased(JUP) && 
-						(briefcaseState == LOCKED || MOVING)&& 
-						(securityState == ENABLED) &&
-						(alarmState == OFF || PENDING || ON) && 
-						(pinEditMode == INACTIVE) )
+		else if (buttonPressedAndReleased(a, JUP) && 
+						(a->briefcaseState == LOCKED || MOVING)&& 
+						(a->securityState == ENABLED) &&
+						(a->alarmState == OFF || PENDING || ON) && 
+						(a->pinEditMode == INACTIVE) )
 		{
-			if (dPinArray[index] < '9') dPinArray[index] += 1;
-			else dPinArray[index] = '0';
+			if (a->dPinArray[a->index] < '9') a->dPinArray[a->index] += 1;
+			else a->dPinArray[a->index] = '0';
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = dPinArray[0];
-			msg.dataArray[1] = dPinArray[1];
-			msg.dataArray[2] = dPinArray[2];
-			msg.dataArray[3] = dPinArray[3];
-			putBufferSave(&msg);		
+			msg.dataArray[0] = a->dPinArray[0];
+			msg.dataArray[1] = a->dPinArray[1];
+			msg.dataArray[2] = a->dPinArray[2];
+			msg.dataArray[3] = a->dPinArray[3];
+			buttonPost(a, &msg);		
 		}
 		// decrese displayedPin digit
-		else if (buttonPressedAndReleased(JDOWN) && 
-						(briefcaseState == LOCKED || MOVING) && 
-						(securityState == ENABLED) &&
-						(alarmState == OFF || PENDING || ON) &&
-						(pinEditMode == INACTIVE) )
+		else if (buttonPressedAndReleased(a, JDOWN) && 
+						(a->briefcaseState == LOCKED || MOVING) && 
+						(a->securityState == ENABLED) &&
+						(a->alarmState == OFF || PENDING || ON) &&
+						(a->pinEditMode == INACTIVE) )
 		{
-			if (dPinArray[index] > '0') dPinArray[index] -= 1;
-			else dPinArray[index] = '9';
+			if (a->dPinArray[a->index] > '0') a->dPinArray[a->index] -= 1;
+			else a->dPinArray[a->index] = '9';
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = dPinArray[0];
-			msg.dataArray[1] = dPinArray[1];
-			msg.dataArray[2] = dPinArray[2];
-			msg.dataArray[3] = dPinArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->dPinArray[0];
+			msg.dataArray[1] = a->dPinArray[1];
+			msg.dataArray[2] = a->dPinArray[2];
+			msg.dataArray[3] = a->dPinArray[3];
+			buttonPost(a, &msg);
 		}
 		// displayedPin digit left
-		else if (buttonPressedAndReleased(JRIGHT) && 
-						(briefcaseState == LOCKED || UNLOCKED || MOVING) && 
-						(securityState == ENABLED ) &&
-						(alarmState == OFF || PENDING || ON) &&
-						(pinEditMode == INACTIVE) )
+		else if (buttonPressedAndReleased(a, JRIGHT) && 
+						(a->briefcaseState == LOCKED || UNLOCKED || MOVING) && 
+						(a->securityState == ENABLED ) &&
+						(a->alarmState == OFF || PENDING || ON) &&
+						(a->pinEditMode == INACTIVE) )
 		{
 			// remove '-' old position
-			positionArray[index] = ' ';
+			a->positionArray[a->index] = ' ';
 			// set '-' new position
-			if ( index > 0) index = ( index - 1 ) % 4;
-			else index=3;
+			if ( a->index > 0) a->index = ( a->index - 1 ) % 4;
+			else a->index=3;
 			
-			positionArray[index] = '-';
+			a->positionArray[a->index] = '-';
 			// sent msg
 		
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);
 		}
 		// displayedPin digit right
-		else if (buttonPressedAndReleased(JLEFT) && 
-						(briefcaseState == LOCKED || UNLOCKED || MOVING) && 
-						(securityState == ENABLED ) &&
-						(alarmState == OFF || PENDING || ON) &&
-						(pinEditMode == INACTIVE) )
+		else if (buttonPressedAndReleased(a, JLEFT) && 
+						(a->briefcaseState == LOCKED || UNLOCKED || MOVING) && 
+						(a->securityState == ENABLED ) &&
+						(a->alarmState == OFF || PENDING || ON) &&
+						(a->pinEditMode == INACTIVE) )
 		{
 			// remove '-' old position
-			positionArray[index] = ' ';
+			a->positionArray[a->index] = ' ';
 			// set '-' new position
-			index = ( index + 1 ) % 4;
-			positionArray[index] = '-';
+			a->index = ( a->index + 1 ) % 4;
+			a->positionArray[a->index] = '-';
 		
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);			
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);			
 		}
 		//---------------------------------------------------------------------------------------------
 		// enter pinEditMode
-		else if (buttonPressedAndReleased(JLEFT) &&
-						(briefcaseState == LOCKED || UNLOCKED) &&
-						(securityState == DISABLED) &&
-						(alarmState == OFF) &&
-						(pinEditMode == INACTIVE) ) 
+		else if (buttonPressedAndReleased(a, JLEFT) &&
+						(a->briefcaseState == LOCKED || UNLOCKED) &&
+						(a->securityState == DISABLED) &&
+						(a->alarmState == OFF) &&
+						(a->pinEditMode == INACTIVE) ) 
 		{
-			pinEditMode = ACTIVE;
+			a->pinEditMode = ACTIVE;
 			msg.taskId = M_PIN_EDIT_ON;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
+			stateChanged(a);
 		
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = sPinArray[0];
-			msg.dataArray[1] = sPinArray[1];
-			msg.dataArray[2] = sPinArray[2];
-			msg.dataArray[3] = sPinArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->sPinArray[0];
+			msg.dataArray[1] = a->sPinArray[1];
+			msg.dataArray[2] = a->sPinArray[2];
+			msg.dataArray[3] = a->sPinArray[3];
+			buttonPost(a, &msg);
 		
-			positionArrayInit();
+			positionArrayInit(a);
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);
 		}		
 		
 		// exit pinEditMode
-    else if (buttonPressedAndReleased(JCENTER) && 
-						(securityState == DISABLED) )
+    else if (buttonPressedAndReleased(a, JCENTER) && 
+						(a->securityState == DISABLED) )
 		{
-			pinEditMode = INACTIVE;
+			a->pinEditMode = INACTIVE;
 			msg.taskId = M_PIN_EDIT_OFF;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
+			stateChanged(a);
 			
 			msg.taskId = M_DISPLAY_CLEAR;
-			putBufferSave(&msg);
+			buttonPost(a, &msg);
 		}
 			
 		// increase savedPin digit
-		else if (buttonPressedAndReleased(JUP) &&
-						(pinEditMode == ACTIVE) && 
-						(securityState == DISABLED) )
+		else if (buttonPressedAndReleased(a, JUP) &&
+						(a->pinEditMode == ACTIVE) && 
+						(a->securityState == DISABLED) )
 		{
-			if (sPinArray[index] < '9') sPinArray[index] += 1;
-			else sPinArray[index] = '0';
+			if (a->sPinArray[a->index] < '9') a->sPinArray[a->index] += 1;
+			else a->sPinArray[a->index] = '0';
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = sPinArray[0];
-			msg.dataArray[1] = sPinArray[1];
-			msg.dataArray[2] = sPinArray[2];
-			msg.dataArray[3] = sPinArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->sPinArray[0];
+			msg.dataArray[1] = a->sPinArray[1];
+			msg.dataArray[2] = a->sPinArray[2];
+			msg.dataArray[3] = a->sPinArray[3];
+			buttonPost(a, &msg);
 		}
 			
 		// decrese savedPin digit
-		else if (buttonPressedAndReleased(JDOWN) &&
-						(pinEditMode == ACTIVE) && 
-						(securityState == DISABLED) )
+		else if (buttonPressedAndReleased(a, JDOWN) &&
+						(a->pinEditMode == ACTIVE) && 
+						(a->securityState == DISABLED) )
 		{
-			if (sPinArray[index] > '0') sPinArray[index] -= 1;
-			else sPinArray[index] = '9';
+			if (a->sPinArray[a->index] > '0') a->sPinArray[a->index] -= 1;
+			else a->sPinArray[a->index] = '9';
 			msg.taskId = M_DISPLAYED_PIN;
-			msg.dataArray[0] = sPinArray[0];
-			msg.dataArray[1] = sPinArray[1];
-			msg.dataArray[2] = sPinArray[2];
-			msg.dataArray[3] = sPinArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->sPinArray[0];
+			msg.dataArray[1] = a->sPinArray[1];
+			msg.dataArray[2] = a->sPinArray[2];
+			msg.dataArray[3] = a->sPinArray[3];
+			buttonPost(a, &msg);
 			  
 		}
 		
 		// savedPin digit left
-		else if (buttonPressedAndReleased(JRIGHT) && 
-						(pinEditMode == ACTIVE) && 
-						(securityState == DISABLED) )
+		else if (buttonPressedAndReleased(a, JRIGHT) && 
+						(a->pinEditMode == ACTIVE) && 
+						(a->securityState == DISABLED) )
 		{
 			// remove '-' old position
-			positionArray[index] = ' ';
+			a->positionArray[a->index] = ' ';
 			// set '-' new position
-			if ( index > 0) index = ( index - 1 ) % 4;
-			else index=3;
+			if ( a->index > 0) a->index = ( a->index - 1 ) % 4;
+			else a->index=3;
 			
-			positionArray[index] = '-';
+			a->positionArray[a->index] = '-';
 			
 			// sent msg
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);
 		}
 		// savedPin digit right
-		else if (buttonPressedAndReleased(JLEFT) && 
-						(pinEditMode == ACTIVE) && 
-						(securityState == DISABLED) )
+		else if (buttonPressedAndReleased(a, JLEFT) && 
+						(a->pinEditMode == ACTIVE) && 
+						(a->securityState == DISABLED) )
 		{
 			// remove '-' old position
-			positionArray[index] = ' ';
+			a->positionArray[a->index] = ' ';
 			// set '-' new position
-			index = ( index + 1 ) % 4;
-			positionArray[index] = '-';
+			a->index = ( a->index + 1 ) % 4;
+			a->positionArray[a->index] = '-';
 		
 			msg.taskId = M_POSITION;
-			msg.dataArray[0] = positionArray[0];
-			msg.dataArray[1] = positionArray[1];
-			msg.dataArray[2] = positionArray[2];
-			msg.dataArray[3] = positionArray[3];
-			putBufferSave(&msg);	
+			msg.dataArray[0] = a->positionArray[0];
+			msg.dataArray[1] = a->positionArray[1];
+			msg.dataArray[2] = a->positionArray[2];
+			msg.dataArray[3] = a->positionArray[3];
+			buttonPost(a, &msg);	
 		}
 
 		//---------------------------------------------------------------------------------------------
+		a->buttonPressed = false;   // a press no branch acted on has no feedback to time
     OSTimeDlyHMSM(0,0,0,100);
   }
 }
@@ -480,46 +708,67 @@ static void appTaskButtons(void *pdata)
 // Potentiometer task
 /*******************************************************************************************************/
 static void appTaskPot(void *pdata) {
+	app_t *a = (app_t *)pdata;
 	message_t msg;
 	
   while (true) 
 	{
-		if ((briefcaseState == LOCKED || UNLOCKED) && 
-				(securityState == DISABLED) &&
-				(alarmState == OFF) &&
-				(pinEditMode == INACTIVE) )
+		if ((a->briefcaseState == LOCKED || UNLOCKED) && 
+				(a->securityState == DISABLED) &&
+				(a->alarmState == OFF) &&
+				(a->pinEditMode == INACTIVE) )
 		{
-			potVal = (120)*potentiometer.read();
-			intVal = (uint8_t)potVal;
-			if(intVal >= 10 && intVal <=120)
+			a->countdownRunning = false;
+			a->potVal = (120)*potentiometer.read();
+			a->intVal = (uint8_t)a->potVal;
+			// post only a new interval: the LCD and telemetry tasks sleep while it stays put
+			if(a->intVal >= 10 && a->intVal <=120 && a->intVal != a->ALARM_INTERVAL)
 			{
-				ALARM_INTERVAL = intVal;
+				a->ALARM_INTERVAL = a->intVal;
 				
 				msg.taskId = M_TIME_INTERVAL;
-				msg.dataArray[0] = ALARM_INTERVAL;
-				msg.dataArray[1] = ALARM_INTERVAL;
-				putBufferSave(&msg);
+				msg.dataArray[0] = a->ALARM_INTERVAL;
+				msg.dataArray[1] = a->ALARM_INTERVAL;
+				putBufferSave(&a->queues[Q_LCD], &msg);
 			}			
 		}
-		else if (briefcaseState == MOVING && 
-						(securityState == ENABLED) &&
-						(alarmState == PENDING) &&
-						(pinEditMode == INACTIVE) )
+		else if (a->briefcaseState == MOVING && 
+						(a->securityState == ENABLED) &&
+						(a->alarmState == PENDING) &&
+						(a->pinEditMode == INACTIVE) )
 		{
-			ALARM_INTERVAL -=1;
+			uint32_t now = usTimeNow();
+			if (a->countdownRunning)
+			{
+				int32_t jitter = (int32_t)(now - a->countdownUs) - COUNTDOWN_PERIOD_US;
+				taskMonRecord(TM_COUNTDOWN, (uint32_t)(jitter < 0 ? -jitter : jitter));
+			}
+			a->countdownUs = now;
+			a->countdownRunning = true;
+			
+			a->ALARM_INTERVAL -=1;
 			
 			msg.taskId = M_COUNTDOWN_VALUE;
-			msg.dataArray[0] = ALARM_INTERVAL;
-			putBufferSave(&msg);
+			msg.dataArray[0] = a->ALARM_INTERVAL;
+			putBufferSave(&a->queues[Q_LCD], &msg);
 			
-			if (ALARM_INTERVAL == 0)
+			if (a->ALARM_INTERVAL == 0)
 			{
-				alarmState = ON;
+				a->alarmState = ON;
 				msg.taskId = M_ALARM_ON;
-				putBufferSave(&msg);
+				putBufferSave(&a->queues[Q_LCD], &msg);
+				eventLogAppend(M_ALARM_ON, 0);
+				stateChanged(a);
 			}
 			OSTimeDlyHMSM(0,0,0,900);
 		}	
+		else
+		{
+			// nothing to adjust or count down until the state changes
+			a->countdownRunning = false;
+			waitForStateChange(a, APP_FLAG_POT);
+			continue;
+		}
     OSTimeDlyHMSM(0,0,0,100);	
   }
 }
@@ -527,30 +776,63 @@ static void appTaskPot(void *pdata) {
 // Accelerometer task
 /*******************************************************************************************************/
 static void appTaskAcc(void *pdata) {
+	app_t *a = (app_t *)pdata;
 	message_t msg;
 	
   while (true) 
 	{
-		if	(briefcaseState == LOCKED && 
-				(securityState == ENABLED) &&
-				(alarmState == OFF) &&
-				(pinEditMode == INACTIVE) )
+		if	(a->briefcaseState == LOCKED && 
+				(a->securityState == ENABLED) &&
+				(a->alarmState == OFF) &&
+				(a->pinEditMode == INACTIVE) )
 		{ 
-			acc.read(accVal[0], accVal[1], accVal[2]);		
+			if (!accRead(a))
+			{
+				OSTimeDlyHMSM(0,0,0,ACC_SAMPLE_PERIOD);
+				continue;
+			}
+			accSummaryAdd(a);
+			motionVerdict_t verdict = motionAdd(&a->motion, a->accVal);
 			for (uint32_t i=0; i<3; i++)
 			{
-				if(accVal[i] >= 40 || accVal[i] <= -40) 
+				if(a->accVal[i] >= 40 || a->accVal[i] <= -40) 
 				{
-					alarmState = PENDING;
-					msg.taskId = M_ALARM_PENDING;
-					putBufferSave(&msg);
-					briefcaseState = MOVING;
-					msg.taskId = M_BRIEFCASE_MOVING;
-					putBufferSave(&msg);
+					// an excursion only raises the alarm once the spectrum says the case is carried
+					if (a->motionSuspect == 0)
+					{
+						a->excursionUs = usTimeNow();   // detection is timed from the first excursion
+					}
+					a->motionSuspect = ACC_DECIDE_WINDOWS;
+					a->motionAxis = (uint8_t)i;
 				} 
 			}
+			if (a->motionSuspect > 0 && verdict == MOTION_CARRIED)
+			{
+				a->motionSuspect = 0;
+				taskMonRecord(TM_ACC, usTimeNow() - a->excursionUs);
+				a->alarmState = PENDING;
+				eventLogAppend(M_ALARM_PENDING, a->motionAxis);
+				msg.taskId = M_ALARM_PENDING;
+				putBufferSave(&a->queues[Q_LCD], &msg);
+				a->briefcaseState = MOVING;
+				msg.taskId = M_BRIEFCASE_MOVING;
+				putBufferSave(&a->queues[Q_LCD], &msg);
+				stateChanged(a);
+			}
+			else if (a->motionSuspect > 0 && verdict != MOTION_NONE)
+			{
+				a->motionSuspect--;   // bumped or still: forget it after a few windows
+			}
 		}
-		OSTimeDlyHMSM(0,0,0,200);
+		else
+		{
+			// only sample while the alarm is armed
+			waitForStateChange(a, APP_FLAG_ACC);
+			motionInit(&a->motion);
+			a->motionSuspect = 0;
+			continue;
+		}
+		OSTimeDlyHMSM(0,0,0,ACC_SAMPLE_PERIOD);
 	}
 }
 
@@ -571,90 +853,106 @@ static void appTaskLcd(void *pdata) {
 	// Frame
 	d->drawRect(x + 10, y + 30, 150, 140, GREEN);
 	
+	app_t *a = (app_t *)pdata;
+	ui_t *ui = &a->ui;
 	message_t msg;
 	while(true)
 	{
-	
-		getBufferSave(&msg);
+		// nothing to draw: sleep until a message arrives. This only keeps the task asleep while idle
+		// because the producers post changes, not repeats (the pot task compares with ALARM_INTERVAL).
+		if (ui->dirty == 0) {
+			getBufferSave(&a->queues[Q_LCD], &msg);
+			uiFold(ui, &msg);
+		}
 		
-		// Info
-		switch(msg.taskId)
-		{
-			// Security states
-			case M_SECURITY_DISABLED:        	
-				d->setCursor(x + 20, y + 40);	d->printf("Security   : OFF    "); break;
-			case M_SECURITY_ENABELD:        	
-				d->setCursor(x + 20, y + 40);	d->printf("Security   : ON     "); break;
-			
-			// Alarm states
-			case M_ALARM_ON:        	
-				d->setCursor(x + 20, y + 55);	d->printf("Alarm      : ON     "); break;
-			case M_ALARM_OFF:					
-				d->setCursor(x + 20, y + 55);	d->printf("Alarm      : OFF    "); break; 
-			case M_ALARM_PENDING:			
-				d->setCursor(x + 20, y + 55);	d->printf("Alarm      : PENDING"); break; 
-			
-			// Time interval / countdown
-		  case M_TIME_INTERVAL:			
-				d->setCursor(x + 20, y + 70);	d->printf("Interval   : %d ", msg.dataArray[0]); 
-				d->setCursor(x + 20, y + 85);	d->printf("Time       : %d ", msg.dataArray[1]); break;
-			case M_COUNTDOWN_VALUE:		
-				d->setCursor(x + 20, y + 85); d->printf("Time       : %d ", msg.dataArray[1]); break;
-			
-			// Briefcase states
-		  case M_BRIEFCASE_UNLOCKED:		
-				d->setCursor(x + 20, y + 100); d->printf("Case       : UNLOCKED"); 
-				d->setCursor(x + 20, y + 115); d->printf("                     "); break;
-			case M_BRIEFCASE_LOCKED:	
-				d->setCursor(x + 20, y + 100); d->printf("Case       : LOCKED  "); 
-				d->setCursor(x + 20, y + 115); d->printf("                     "); break;
-			case M_BRIEFCASE_MOVING:  
-				d->setCursor(x + 20, y + 115); d->printf("             MOVING  "); break;
-			
-			// Code display
-			case M_DISPLAYED_PIN:
-				d->setCursor(x + 20, y + 130); d->printf("Code       : %c %c %c %c", 
-				msg.dataArray[0], msg.dataArray[1], msg.dataArray[2], msg.dataArray[3]); break;
-			
-			// Clear Display
-			case M_DISPLAY_CLEAR:
-				d->setCursor(x + 20, y + 130); d->printf("                     ");
-				d->setCursor(x + 20, y + 140); d->printf("                     ");
-				d->setCursor(x + 20, y + 150); d->printf("                     "); break;
-
-			// Current digit
-			case M_POSITION:
-				d->setCursor(x + 20, y + 140); d->printf("             %c %c %c %c",
-				msg.dataArray[0], msg.dataArray[1], msg.dataArray[2], msg.dataArray[3]); break;
-			
-			// Edit Mode
-			case M_PIN_EDIT_ON:
-				d->setCursor(x + 20, y + 150); d->printf("             Edit Pin"); break;			
-		}		
-		OSTimeDlyHMSM(0,0,0,100);
+		// keep folding messages in until the next frame is due
+		while (true) {
+			// unsigned age, clamped to one frame: a long idle can't turn into a wrapped, huge wait
+			uint32_t sinceUs = usTimeNow() - ui->frameUs;
+			int32_t leftUs = sinceUs >= LCD_FRAME_US ? 0 : (int32_t)(LCD_FRAME_US - sinceUs);
+			uint16_t ticks = leftUs <= 0 ? 0 : (uint16_t)(((uint32_t)leftUs * OS_TICKS_PER_SEC + 999999) / 1000000);
+			if (!tryGetBufferSave(&a->queues[Q_LCD], &msg, ticks)) {
+				break;
+			}
+			uiFold(ui, &msg);
+		}
+		if (ui->dirty == 0) {
+			continue;   // the messages changed nothing on screen
+		}
+		
+		taskMonStart(TM_LCD);
+		uiDrawFrame(ui);
+		taskMonEnd(TM_LCD);
 	}	
 }
 
 // LED task
 /*******************************************************************************************************/
 static void appTaskLed(void *pdata) {	
+	app_t *a = (app_t *)pdata;
   while (true) {
-		if (alarmState == ON) {
-      led1 = !led1;
-			led2 = !led2;
-			led3 = !led3;
-			led4 = !led4;
+		if (a->alarmState == ON) {
+			// four LEDs on three ports: three read-modify-writes
+			taskMonStart(TM_LED);
+			ledsPort1::toggle();
+			led2::toggle();
+			led4::toggle();
+			taskMonEnd(TM_LED);
+		}
+		else {
+			// nothing to flash until the alarm goes off
+			waitForStateChange(a, APP_FLAG_LED);
+			continue;
+		}
+    OSTimeDly(a->flashingDelay);
+  }
+}
+
+// Telemetry task
+/*******************************************************************************************************/
+static void appTaskTelemetry(void *pdata) {
+	app_t *a = (app_t *)pdata;
+	INT32U nextReport = OSTimeGet() + TELEMETRY_REPORT_TICKS;
+	
+	telemetryPost(TLM_FOOTPRINT, &appFootprint, sizeof(appFootprint));
+  while (true) {
+		// sleep until there is something to send or the next report is due
+		int32_t left = (int32_t)(nextReport - OSTimeGet());
+		if (left > 0) {
+			telemetryWait((uint32_t)left);
+		}
+		if ((int32_t)(OSTimeGet() - nextReport) >= 0) {
+			nextReport += TELEMETRY_REPORT_TICKS;
+			if ((int32_t)(OSTimeGet() - nextReport) >= 0) {
+				nextReport = OSTimeGet() + TELEMETRY_REPORT_TICKS;   // fell behind, don't burst
+			}
+			telemetryPostCounters(a);
+		}
+    OSTimeDlyHMSM(0,0,0,TELEMETRY_PERIOD);
+		while (!telemetryFlush()) {
+			// previous frame still on the wire
+			OSTimeDlyHMSM(0,0,0,TELEMETRY_PERIOD);
 		}
-    OSTimeDly(flashingDelay);
+  }
+}
+
+// Event log task
+/*******************************************************************************************************/
+static void appTaskLog(void *pdata) {
+	/* Runs at the lowest priority so page programming never delays the alarm tasks */
+  while (true) {
+		eventLogWait(LOG_FLUSH_DELAY);
+		eventLogService();
   }
 }
 
 // Funktions
 /*******************************************************************************************************/
 /*
- * @brief buttonPressedAndReleased(button) tests to see if the button has
+ * @brief buttonPressedAndReleased(a, button) tests to see if the button has
  *        been pressed then released.
  *        
+ * @param a - the application, which notes when a press was accepted
  * @param button - the name of the button
  * @result - true if button pressed then released, otherwise false
  *
@@ -666,7 +964,7 @@ static void appTaskLed(void *pdata) {
  */
 
 /*******************************************************************************************************/
-bool buttonPressedAndReleased(buttonId_t b) {
+bool buttonPressedAndReleased(app_t *a, buttonId_t b) {
 //	bool result = false;
 //	static uint32_t savedState[5] = {1,1,1,1,1};
 //	uint32_t state;
@@ -676,7 +974,12 @@ bool buttonPressedAndReleased(buttonId_t b) {
 //	}
 //	savedState[b] = state;
 //	return result;
-	if(buttons[b].read()== 0) { OSTimeDlyHMSM(0,0,0,100); return true;}
+	if((joystick::read() & (1UL << buttonPins[b])) == 0) {
+		OSTimeDlyHMSM(0,0,0,100);
+		a->buttonPressUs = usTimeNow();   // response time is measured from the end of the debounce
+		a->buttonPressed = true;
+		return true;
+	}
 	else return false;
 }
 
@@ -701,6 +1004,33 @@ bool buttonPressedAndReleased(buttonId_t b) {
 //}
 
 
+/*******************************************************************************************************/
+/*
+ * @brief Post a message from the buttons task. The first message after a
+ *        press carries the press time, so the LCD task can record press to
+ *        pixel against TM_BUTTONS.
+ */
+void buttonPost(app_t *a, message_t const *msg) {
+	if (a->buttonPressed) {
+		putBufferSaveTimed(&a->queues[Q_LCD], msg, TM_BUTTONS, a->buttonPressUs);
+		a->buttonPressed = false;
+	}
+	else {
+		putBufferSave(&a->queues[Q_LCD], msg);
+	}
+}
+
+/*******************************************************************************************************/
+void gpioInit(void) {
+	joystick::input();   // pull-ups are the IOCON reset default
+	ledsPort1::clear();
+	ledsPort1::output();
+	led2::clear();
+	led2::output();
+	led4::clear();
+	led4::output();
+}
+
 /*******************************************************************************************************/
 bool accInit(MMA7455& acc) {
   bool result = true;
@@ -717,70 +1047,384 @@ bool accInit(MMA7455& acc) {
 }
 
 /*******************************************************************************************************/
-bool provePin() {
-	if ( dPinArray[0] == sPinArray[0] &&
-			 dPinArray[1] == sPinArray[1] &&
-			 dPinArray[2] == sPinArray[2] &&
-			 dPinArray[3] == sPinArray[3] ) {return true;}
+bool provePin(app_t *a) {
+	if ( a->dPinArray[0] == a->sPinArray[0] &&
+			 a->dPinArray[1] == a->sPinArray[1] &&
+			 a->dPinArray[2] == a->sPinArray[2] &&
+			 a->dPinArray[3] == a->sPinArray[3] ) {return true;}
 	else {return false;}
 }
 
-void displayInit(void){
+void displayInit(app_t *a){
 	message_t msg;
 	
 	msg.taskId = M_SECURITY_DISABLED;
-	putBufferSave(&msg);
+	putBufferSave(&a->queues[Q_LCD], &msg);
 
 	msg.taskId = M_ALARM_OFF;
-	putBufferSave(&msg);
+	putBufferSave(&a->queues[Q_LCD], &msg);
 	
 	msg.taskId = M_TIME_INTERVAL;
-	msg.dataArray[0] = ALARM_INTERVAL;
-	msg.dataArray[1] = ALARM_INTERVAL;
-	putBufferSave(&msg);
+	msg.dataArray[0] = a->ALARM_INTERVAL;
+	msg.dataArray[1] = a->ALARM_INTERVAL;
+	putBufferSave(&a->queues[Q_LCD], &msg);
 	
 	msg.taskId = M_BRIEFCASE_UNLOCKED;
-	putBufferSave(&msg);
+	putBufferSave(&a->queues[Q_LCD], &msg);
 	
 	msg.taskId = M_DISPLAY_CLEAR;
-	putBufferSave(&msg);
+	putBufferSave(&a->queues[Q_LCD], &msg);
+}
+
+void appInit(app_t *a){
+	uint8_t err;
+	
+	a->flashingDelay = FLASH_INITIAL_DELAY;
+	a->ALARM_INTERVAL = 10;
+	a->sPinArray[0] = '1';
+	a->sPinArray[1] = '0';
+	a->sPinArray[2] = '0';
+	a->sPinArray[3] = '0';
+	a->accSamples = 0;
+	a->countdownRunning = false;
+	a->taskMonNext = TM_BUTTONS;
+	a->buttonPressed = false;
+	a->accXfer.address = ACC_I2C_ADDRESS;
+	a->accXfer.reg = ACC_REG_XOUT8;
+	a->accXfer.write = false;
+	a->accXfer.length = sizeof(a->accRaw);
+	a->accXfer.data = a->accRaw;
+	a->accXfer.done = OSSemCreate(0);
+	a->accXfer.result = I2C_DONE;
+	a->accStalls = 0;
+	a->accBusResets = 0;
+	motionInit(&a->motion);
+	a->motionSuspect = 0;
+	dPinArrayInit(a);
+	positionArrayInit(a);
+	statesInit(a);
+	for (uint32_t q = 0; q < APP_QUEUE_COUNT; q++)
+	{
+		bufferSaveInit(&a->queues[q], &a->queueSlots[queueOffset(q)], appQueues[q].capacity);
+	}
+	a->ui.dirty = 0;
+	a->ui.frameUs = 0;
+	a->ui.windowUs = 0;
+	for (uint32_t row = 0; row < UI_ROWS; row++)
+	{
+		a->ui.rowMonitor[row] = TASKMON_NONE;
+	}
+	a->stateFlags = OSFlagCreate(0, &err);
+}
+
+/*
+ * @brief Read all three axes in one I2C burst. The CPU is free for other
+ *        tasks while the transfer runs under interrupt.
+ * @result false if the read failed or timed out
+ */
+bool accRead(app_t *a){
+	uint8_t err;
+	
+	if (a->accXfer.result == I2C_PENDING)
+	{
+		// an earlier read timed out and is still queued: give it a few periods, then reset the bus
+		if (++a->accStalls < ACC_I2C_STALLS) return false;
+		i2cReset();
+		a->accStalls = 0;
+		if (a->accBusResets < 255) a->accBusResets++;
+		eventLogAppend(M_ACC_BUS_RESET, a->accBusResets);
+	}
+	while (OSSemAccept(a->accXfer.done) > 0)
+	{
+		// drop the post of a read that completed after it timed out
+	}
+	i2cSubmit(&a->accXfer);
+	OSSemPend(a->accXfer.done, ACC_I2C_TIMEOUT, &err);
+	if (err != OS_ERR_NONE || a->accXfer.result != I2C_DONE) return false;
+	a->accStalls = 0;
+	for (uint32_t i=0; i<3; i++)
+	{
+		a->accVal[i] = (int8_t)a->accRaw[i];
+	}
+	return true;
+}
+
+/*
+ * @brief Track the range of every axis and send it as one TLM_ACC record
+ *        every ACC_SUMMARY_SAMPLES samples.
+ */
+void accSummaryAdd(app_t *a){
+	for (uint32_t i=0; i<3; i++)
+	{
+		int8_t v = (int8_t)a->accVal[i];
+		if (a->accSamples == 0 || v < a->accMin[i]) a->accMin[i] = v;
+		if (a->accSamples == 0 || v > a->accMax[i]) a->accMax[i] = v;
+	}
+	if (++a->accSamples == ACC_SUMMARY_SAMPLES)
+	{
+		int8_t summary[6] = { a->accMin[0], a->accMax[0], a->accMin[1], a->accMax[1],
+		                      a->accMin[2], a->accMax[2] };
+		telemetryPost(TLM_ACC, summary, sizeof(summary));
+		a->accSamples = 0;
+	}
 }
 
-void statesInit(void){
-  briefcaseState = UNLOCKED;
-	alarmState = OFF;
-	securityState = DISABLED;
-	pinEditMode = INACTIVE;
+/*
+ * @brief Wake every task that is waiting for the state to change. Call after
+ *        all the state variables of a transition have been updated.
+ */
+void stateChanged(app_t *a){
+	uint8_t err;
+	OSFlagPost(a->stateFlags, APP_FLAG_ALL, OS_FLAG_SET, &err);
+}
+
+/*
+ * @brief Block until stateChanged() is called. The flag is consumed, so a
+ *        change made before the call returns at once instead of being lost.
+ */
+void waitForStateChange(app_t *a, OS_FLAGS flag){
+	uint8_t err;
+	OSFlagPend(a->stateFlags, flag, OS_FLAG_WAIT_SET_ANY + OS_FLAG_CONSUME, 0, &err);
+}
+
+/*
+ * @brief Send the telemetry, power and OS counters
+ */
+void telemetryPostCounters(app_t *a){
+	telemetryCounters_t counters;
+	ticklessStats_t power;
+	uint32_t os[2];
+	
+	telemetryGetCounters(&counters);
+	telemetryPost(TLM_COUNTERS, &counters, sizeof(counters));
+	ticklessGetStats(&power);
+	telemetryPost(TLM_POWER, &power, sizeof(power));
+	os[0] = OSTimeGet();
+	os[1] = OSCtxSwCtr;
+	telemetryPost(TLM_OS, os, sizeof(os));
+	
+	// one task per report, the histograms don't all fit in one batch
+	uint8_t next = a->taskMonNext;
+	taskMonStats_t tm;
+	telemetryTaskMon_t rec;
+	taskMonGet(next, &tm);
+	rec.id = next;
+	rec.reserved = 0;
+	rec.misses = (uint16_t)(tm.misses > 0xFFFF ? 0xFFFF : tm.misses);
+	rec.count = tm.count;
+	rec.worstUs = tm.worstUs;
+	for (uint32_t i=0; i<TASKMON_BUCKETS; i++)
+	{
+		rec.histogram[i] = (uint16_t)(tm.histogram[i] > 0xFFFF ? 0xFFFF : tm.histogram[i]);
+	}
+	telemetryPost(TLM_TASKMON, &rec, sizeof(rec));
+	a->taskMonNext = (next == TM_LED) ? TM_BUTTONS : next + 1;
+}
+
+void taskMonSetup(void){
+	taskMonInit(TM_BUTTONS, TM_BUTTONS_DEADLINE_US);
+	taskMonInit(TM_COUNTDOWN, TM_COUNTDOWN_DEADLINE_US);
+	taskMonInit(TM_ACC, TM_ACC_DEADLINE_US);
+	taskMonInit(TM_LCD, TM_LCD_DEADLINE_US);
+	taskMonInit(TM_LED, TM_LED_DEADLINE_US);
+}
+
+/*******************************************************************************************************/
+bool uiSet(ui_t *ui, uiRow_t row, uint8_t v0, uint8_t v1, uint8_t v2, uint8_t v3){
+	uint8_t *v = ui->value[row];
+	if (v[0] == v0 && v[1] == v1 && v[2] == v2 && v[3] == v3) {
+		return false;
+	}
+	v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+	if ((ui->dirty & (1U << row)) == 0) {
+		ui->dirty |= (uint16_t)(1U << row);
+		ui->dirtyUs[row] = ui->postedUs;
+	}
+	if (ui->monitor != TASKMON_NONE) {
+		// the first row a timed message changes stops its clock
+		ui->rowMonitor[row] = ui->monitor;
+		ui->rowMonitorUs[row] = ui->postedUs;
+		ui->monitor = TASKMON_NONE;
+	}
+	return true;
+}
+
+/*******************************************************************************************************/
+void uiFold(ui_t *ui, message_t const *msg){
+	uint8_t const *data = msg->dataArray;
+	uint8_t type = (uint8_t)msg->taskId;
+	
+	ui->postedUs = msg->postedUs;   // lag includes the time spent in the queue
+	ui->monitor = msg->monitor;
+	
+	bool changed = false;
+	switch(msg->taskId)
+	{
+		case M_SECURITY_DISABLED:
+		case M_SECURITY_ENABELD:
+			changed |= uiSet(ui, UI_SECURITY, type, 0, 0, 0); break;
+		case M_ALARM_ON:
+		case M_ALARM_OFF:
+		case M_ALARM_PENDING:
+			changed |= uiSet(ui, UI_ALARM, type, 0, 0, 0); break;
+		case M_TIME_INTERVAL:
+			changed |= uiSet(ui, UI_INTERVAL, data[0], 0, 0, 0);
+			changed |= uiSet(ui, UI_TIME, data[1], 0, 0, 0); break;
+		case M_COUNTDOWN_VALUE:
+			changed |= uiSet(ui, UI_TIME, data[0], 0, 0, 0); break;
+		case M_BRIEFCASE_UNLOCKED:
+		case M_BRIEFCASE_LOCKED:
+			changed |= uiSet(ui, UI_CASE, type, 0, 0, 0);
+			changed |= uiSet(ui, UI_MOVING, 0, 0, 0, 0); break;
+		case M_BRIEFCASE_MOVING:
+			changed |= uiSet(ui, UI_MOVING, 1, 0, 0, 0); break;
+		case M_DISPLAYED_PIN:
+			changed |= uiSet(ui, UI_CODE, data[0], data[1], data[2], data[3]); break;
+		case M_POSITION:
+			changed |= uiSet(ui, UI_POSITION, data[0], data[1], data[2], data[3]); break;
+		case M_DISPLAY_CLEAR:
+			changed |= uiSet(ui, UI_CODE, 0, 0, 0, 0);
+			changed |= uiSet(ui, UI_POSITION, 0, 0, 0, 0);
+			changed |= uiSet(ui, UI_EDIT, 0, 0, 0, 0); break;
+		case M_PIN_EDIT_ON:
+			changed |= uiSet(ui, UI_EDIT, 1, 0, 0, 0); break;
+		default:
+			changed = true;   // not shown, but still a state change
+			break;
+	}
+	
+	// repeats that change nothing on screen are not sent either
+	if (changed) {
+		uint8_t state[5] = { type, data[0], data[1], data[2], data[3] };
+		telemetryPost(TLM_STATE, state, sizeof(state));
+	}
+}
+
+/*******************************************************************************************************/
+void uiDrawFrame(ui_t *ui){
+	uint32_t start = usTimeNow();
+	
+	for (uint32_t row = 0; row < UI_ROWS; row++) {
+		if ((ui->dirty & (1U << row)) == 0) {
+			continue;
+		}
+		if (row >= UI_FIRST_COSMETIC && usTimeNow() - start > LCD_FRAME_BUDGET_US) {
+			ui->dropped++;   // stays dirty, drawn with its latest value next frame
+			continue;
+		}
+		uiDrawRow(ui, (uiRow_t)row);
+		ui->dirty &= (uint16_t)~(1U << row);
+		
+		uint32_t lagUs = usTimeNow() - ui->dirtyUs[row];
+		if (ui->rowMonitor[row] != TASKMON_NONE) {
+			taskMonRecord(ui->rowMonitor[row], usTimeNow() - ui->rowMonitorUs[row]);
+			ui->rowMonitor[row] = TASKMON_NONE;
+		}
+		ui->lagSumUs += lagUs;
+		ui->lagCount++;
+		if (lagUs > ui->lagMaxUs) {
+			ui->lagMaxUs = lagUs;
+		}
+	}
+	
+	uint32_t end = usTimeNow();
+	ui->frameUs = start;
+	ui->frames++;
+	ui->frameSumUs += end - start;
+	
+	// fps, average frame time and state-to-pixel lag once per window
+	uint32_t windowUs = end - ui->windowUs;
+	if (windowUs >= LCD_REPORT_US) {
+		telemetryUi_t report;
+		report.fpsX10 = (uint16_t)(ui->frames * 10000UL / (windowUs / 1000));
+		report.dropped = ui->dropped;
+		report.frameAvgUs = ui->frameSumUs / ui->frames;
+		report.lagAvgUs = ui->lagCount ? ui->lagSumUs / ui->lagCount : 0;
+		report.lagMaxUs = ui->lagMaxUs;
+		telemetryPost(TLM_UI, &report, sizeof(report));
+		
+		ui->windowUs = end;
+		ui->frames = 0;
+		ui->dropped = 0;
+		ui->frameSumUs = 0;
+		ui->lagSumUs = 0;
+		ui->lagMaxUs = 0;
+		ui->lagCount = 0;
+	}
+}
+
+/*******************************************************************************************************/
+void uiDrawRow(ui_t const *ui, uiRow_t row){
+	static const uint8_t rowY[UI_ROWS] = { 85, 115, 130, 145, 70, 160, 100, 170, 180 };
+	uint8_t const *v = ui->value[row];
+	
+	d->setCursor(170, rowY[row]);
+	switch(row)
+	{
+		case UI_SECURITY:
+			d->printf(v[0] == M_SECURITY_ENABELD ? "Security   : ON     " : "Security   : OFF    "); break;
+		case UI_ALARM:
+			d->printf(v[0] == M_ALARM_ON      ? "Alarm      : ON     " :
+			          v[0] == M_ALARM_PENDING ? "Alarm      : PENDING" : "Alarm      : OFF    "); break;
+		case UI_INTERVAL:
+			d->printf("Interval   : %d  ", v[0]); break;
+		case UI_TIME:
+			d->printf("Time       : %d  ", v[0]); break;
+		case UI_CASE:
+			d->printf(v[0] == M_BRIEFCASE_LOCKED ? "Case       : LOCKED  " : "Case       : UNLOCKED"); break;
+		case UI_MOVING:
+			d->printf(v[0] ? "             MOVING  " : "                     "); break;
+		case UI_CODE:
+			if (v[0]) { d->printf("Code       : %c %c %c %c", v[0], v[1], v[2], v[3]); }
+			else      { d->printf("                     "); }
+			break;
+		case UI_POSITION:
+			if (v[0]) { d->printf("             %c %c %c %c", v[0], v[1], v[2], v[3]); }
+			else      { d->printf("                     "); }
+			break;
+		case UI_EDIT:
+			d->printf(v[0] ? "             Edit Pin" : "                     "); break;
+		default:
+			break;
+	}
+}
+
+/*******************************************************************************************************/
+void statesInit(app_t *a){
+  a->briefcaseState = UNLOCKED;
+	a->alarmState = OFF;
+	a->securityState = DISABLED;
+	a->pinEditMode = INACTIVE;
 }
 
-void dPinArrayInit(void){
-	index = 0;
-	dPinArray[0] = '0';
-	dPinArray[1] = '0';
-	dPinArray[2] = '0';
-	dPinArray[3] = '0';
+void dPinArrayInit(app_t *a){
+	a->index = 0;
+	a->dPinArray[0] = '0';
+	a->dPinArray[1] = '0';
+	a->dPinArray[2] = '0';
+	a->dPinArray[3] = '0';
 }
 
-void dPinArrayClear(void){
-	dPinArray[0] = ' ';
-	dPinArray[1] = ' ';
-	dPinArray[2] = ' ';
-	dPinArray[3] = ' ';
+void dPinArrayClear(app_t *a){
+	a->dPinArray[0] = ' ';
+	a->dPinArray[1] = ' ';
+	a->dPinArray[2] = ' ';
+	a->dPinArray[3] = ' ';
 }
 
-void positionArrayInit(void){
-	index = 0;
-	positionArray[0] = '-';
-	positionArray[1] = ' ';
-	positionArray[2] = ' ';
-	positionArray[3] = ' ';
+void positionArrayInit(app_t *a){
+	a->index = 0;
+	a->positionArray[0] = '-';
+	a->positionArray[1] = ' ';
+	a->positionArray[2] = ' ';
+	a->positionArray[3] = ' ';
 }
 
-void positionArrayClear(void){
-	positionArray[0] = ' ';
-	positionArray[1] = ' ';
-	positionArray[2] = ' ';
-	positionArray[3] = ' ';
+void positionArrayClear(app_t *a){
+	a->positionArray[0] = ' ';
+	a->positionArray[1] = ' ';
+	a->positionArray[2] = ' ';
+	a->positionArray[3] = ' ';
 }
 
 
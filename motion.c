@@ -0,0 +1,181 @@
+#include <math.h>
+#include <string.h>
+#include "motion.h"
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#include <LPC407x_8x_177x_8x.h>    /* CMSIS SIMD intrinsics */
+#endif
+
+enum {
+	LOW_FIRST_BIN  = 1,     /* 1.6 - 4.7Hz: walking sway */
+	LOW_LAST_BIN   = 3,
+	HIGH_FIRST_BIN = 6,     /* 9.4 - 48Hz: impacts */
+	HIGH_LAST_BIN  = MOTION_FFT_SIZE / 2 - 1,
+	STILL_ENERGY   = 50UL,  /* below this in both bands nothing is moving */
+	SWAY_RATIO     = 2UL,   /* low band must beat the high band by this much */
+	SWAY_WINDOWS   = 2      /* consecutive sway windows before it counts as carried */
+};
+
+static int16_t hann[MOTION_FFT_SIZE];          /* Q15 */
+static uint32_t twiddle[MOTION_FFT_SIZE / 2];  /* packed Q15: cos in the low, -sin in the high halfword */
+static uint8_t bitReverse[MOTION_FFT_SIZE];
+static uint8_t tablesReady;
+
+static void tablesInit(void) {
+	uint32_t n;
+	uint32_t bit;
+	uint32_t r;
+	const float pi = 3.14159265f;
+
+	for (n = 0; n < MOTION_FFT_SIZE; n++) {
+		hann[n] = (int16_t)(32767.0f * (0.5f - 0.5f * cosf(2.0f * pi * n / (MOTION_FFT_SIZE - 1))));
+		for (r = 0, bit = 1; bit < MOTION_FFT_SIZE; bit <<= 1) {
+			r = (r << 1) | ((n & bit) ? 1U : 0U);
+		}
+		bitReverse[n] = (uint8_t)r;
+	}
+	for (n = 0; n < MOTION_FFT_SIZE / 2; n++) {
+		int16_t c = (int16_t)(32767.0f * cosf(2.0f * pi * n / MOTION_FFT_SIZE));
+		int16_t s = (int16_t)(-32767.0f * sinf(2.0f * pi * n / MOTION_FFT_SIZE));
+		twiddle[n] = (uint16_t)c | ((uint32_t)(uint16_t)s << 16);
+	}
+	tablesReady = 1;
+}
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+
+/*
+ * @brief In-place radix-2 FFT on packed Q15 complex values (imaginary in the
+ *        top halfword). Each stage halves the result, so the output is the
+ *        DFT divided by MOTION_FFT_SIZE. Cortex-M4 SIMD version.
+ */
+static void fft(uint32_t *x) {
+	uint32_t half;
+	uint32_t step;
+	uint32_t i;
+	uint32_t j;
+	uint32_t t;
+
+	for (half = 1, step = MOTION_FFT_SIZE / 2; half < MOTION_FFT_SIZE; half <<= 1, step >>= 1) {
+		for (i = 0; i < MOTION_FFT_SIZE; i += 2 * half) {
+			for (j = 0; j < half; j++) {
+				uint32_t b = x[i + j + half];
+				uint32_t wk = twiddle[j * step];
+				t = __PKHBT(__SMUSD(b, wk) >> 15, __SMUADX(b, wk) >> 15, 16);  /* b * w */
+				x[i + j + half] = __SHSUB16(x[i + j], t);                       /* (a - t) / 2 */
+				x[i + j] = __SHADD16(x[i + j], t);                              /* (a + t) / 2 */
+			}
+		}
+	}
+}
+
+#else
+
+/*
+ * @brief In-place radix-2 FFT on packed Q15 complex values (imaginary in the
+ *        top halfword). Each stage halves the result, so the output is the
+ *        DFT divided by MOTION_FFT_SIZE. Portable version.
+ */
+static void fft(uint32_t *x) {
+	uint32_t half;
+	uint32_t step;
+	uint32_t i;
+	uint32_t j;
+
+	for (half = 1, step = MOTION_FFT_SIZE / 2; half < MOTION_FFT_SIZE; half <<= 1, step >>= 1) {
+		for (i = 0; i < MOTION_FFT_SIZE; i += 2 * half) {
+			for (j = 0; j < half; j++) {
+				int32_t ar = (int16_t)(x[i + j] & 0xFFFFU);
+				int32_t ai = (int16_t)(x[i + j] >> 16);
+				int32_t br = (int16_t)(x[i + j + half] & 0xFFFFU);
+				int32_t bi = (int16_t)(x[i + j + half] >> 16);
+				int32_t wr = (int16_t)(twiddle[j * step] & 0xFFFFU);
+				int32_t wi = (int16_t)(twiddle[j * step] >> 16);
+				int32_t tr = (br * wr - bi * wi) >> 15;
+				int32_t ti = (br * wi + bi * wr) >> 15;
+				x[i + j] = (uint16_t)((ar + tr) >> 1) | ((uint32_t)(uint16_t)((ai + ti) >> 1) << 16);
+				x[i + j + half] = (uint16_t)((ar - tr) >> 1) | ((uint32_t)(uint16_t)((ai - ti) >> 1) << 16);
+			}
+		}
+	}
+}
+
+#endif
+
+static uint32_t binPower(uint32_t bin) {
+	int32_t re = (int16_t)(bin & 0xFFFFU);
+	int32_t im = (int16_t)(bin >> 16);
+	return (uint32_t)(re * re + im * im) >> 6;   /* keeps a 26 bin sum inside 32 bits */
+}
+
+/*
+ * @brief Window, transform and classify the newest MOTION_FFT_SIZE samples
+ */
+static motionVerdict_t classify(motion_t *m) {
+	uint32_t x[MOTION_FFT_SIZE];
+	int32_t mean = 0;
+	uint32_t n;
+	uint32_t k;
+
+	for (n = 0; n < MOTION_FFT_SIZE; n++) {
+		mean += m->samples[n];
+	}
+	mean /= MOTION_FFT_SIZE;   /* gravity would otherwise leak into the low band */
+	for (n = 0; n < MOTION_FFT_SIZE; n++) {
+		int32_t s = m->samples[(m->head + n) % MOTION_FFT_SIZE] - mean;   /* oldest first */
+		x[bitReverse[n]] = (uint16_t)((s * hann[n]) >> 15);               /* real input */
+	}
+	fft(x);
+
+	m->lowEnergy = 0;
+	for (k = LOW_FIRST_BIN; k <= LOW_LAST_BIN; k++) {
+		m->lowEnergy += binPower(x[k]);
+	}
+	m->highEnergy = 0;
+	for (k = HIGH_FIRST_BIN; k <= HIGH_LAST_BIN; k++) {
+		m->highEnergy += binPower(x[k]);
+	}
+
+	if (m->lowEnergy < STILL_ENERGY && m->highEnergy < STILL_ENERGY) {
+		m->swayWindows = 0;
+		return MOTION_STILL;
+	}
+	if (m->lowEnergy > SWAY_RATIO * m->highEnergy) {
+		if (++m->swayWindows >= SWAY_WINDOWS) {
+			m->swayWindows = SWAY_WINDOWS;
+			return MOTION_CARRIED;
+		}
+		return MOTION_STILL;   /* not sustained yet */
+	}
+	m->swayWindows = 0;
+	return MOTION_BUMPED;
+}
+
+void motionInit(motion_t *m) {
+	if (!tablesReady) {
+		tablesInit();
+	}
+	memset(m, 0, sizeof(*m));
+}
+
+/*
+ * @brief Add one accelerometer sample
+ * @param acc - x, y and z in MMA7455 8-bit counts
+ * @result a verdict every MOTION_HOP samples once the window is full,
+ *         MOTION_NONE otherwise
+ */
+motionVerdict_t motionAdd(motion_t *m, int32_t const acc[3]) {
+	int32_t sum = (acc[0] < 0 ? -acc[0] : acc[0])     /* L1 norm, orientation independent enough */
+	            + (acc[1] < 0 ? -acc[1] : acc[1])
+	            + (acc[2] < 0 ? -acc[2] : acc[2]);
+
+	m->samples[m->head] = (int16_t)(sum << 6);        /* at most 384 << 6, fits Q15 */
+	m->head = (uint8_t)((m->head + 1U) % MOTION_FFT_SIZE);
+	if (m->filled < MOTION_FFT_SIZE) {
+		m->filled++;
+	}
+	if (++m->sinceWindow < MOTION_HOP || m->filled < MOTION_FFT_SIZE) {
+		return MOTION_NONE;
+	}
+	m->sinceWindow = 0;
+	return classify(m);
+}
@@ -0,0 +1,46 @@
+#ifndef __MOTION_H__
+#define __MOTION_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Tells a case being carried from a bump on the table. Every MOTION_HOP
+ * accelerometer samples the last MOTION_FFT_SIZE are windowed and run
+ * through a Q15 FFT; carrying shows up as sustained low-frequency sway,
+ * a bump as a short broadband spike.
+ */
+
+enum {
+	MOTION_FFT_SIZE = 64,   /* 0.64s at 100Hz, 1.5625Hz per bin */
+	MOTION_HOP      = 32    /* samples between windows */
+};
+
+typedef enum {
+	MOTION_NONE = 0,        /* no window completed by this sample */
+	MOTION_STILL,
+	MOTION_BUMPED,
+	MOTION_CARRIED
+} motionVerdict_t;
+
+typedef struct {
+	int16_t samples[MOTION_FFT_SIZE];  /* ring of the newest samples */
+	uint8_t head;                      /* where the next sample goes */
+	uint8_t filled;                    /* samples held, up to MOTION_FFT_SIZE */
+	uint8_t sinceWindow;               /* samples since the last window */
+	uint8_t swayWindows;               /* consecutive low-band dominated windows */
+	uint32_t lowEnergy;                /* band energies of the last window */
+	uint32_t highEnergy;
+} motion_t;
+
+void motionInit(motion_t *m);
+motionVerdict_t motionAdd(motion_t *m, int32_t const acc[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
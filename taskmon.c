@@ -0,0 +1,80 @@
+#include <string.h>
+#include <ucos_ii.h>
+#include "timer.h"
+#include "taskmon.h"
+
+static const uint32_t bucketLimitUs[TASKMON_BUCKETS - 1] = {
+	100UL, 500UL, 1000UL, 5000UL, 10000UL, 50000UL, 200000UL
+};
+
+static taskMonStats_t stats[TASKMON_MAX_TASKS];
+static uint32_t startUs[TASKMON_MAX_TASKS];
+
+/*
+ * @brief Clear the statistics of a task and set its deadline
+ */
+void taskMonInit(uint8_t id, uint32_t deadlineUs) {
+	if (id >= TASKMON_MAX_TASKS) {
+		return;
+	}
+	memset(&stats[id], 0, sizeof(stats[id]));
+	stats[id].deadlineUs = deadlineUs;
+}
+
+void taskMonStart(uint8_t id) {
+	if (id < TASKMON_MAX_TASKS) {
+		startUs[id] = usTimeNow();
+	}
+}
+
+void taskMonEnd(uint8_t id) {
+	if (id < TASKMON_MAX_TASKS) {
+		taskMonRecord(id, usTimeNow() - startUs[id]);
+	}
+}
+
+/*
+ * @brief Record a measurement taken some other way, e.g. period jitter
+ */
+void taskMonRecord(uint8_t id, uint32_t us) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	taskMonStats_t *s;
+	uint32_t b = 0;
+
+	if (id >= TASKMON_MAX_TASKS) {
+		return;
+	}
+	while (b < TASKMON_BUCKETS - 1 && us > bucketLimitUs[b]) {
+		b++;
+	}
+	s = &stats[id];
+	OS_ENTER_CRITICAL();
+	s->count++;
+	s->histogram[b]++;
+	if (us > s->deadlineUs) {
+		s->misses++;
+	}
+	if (us > s->worstUs) {
+		s->worstUs = us;
+	}
+	OS_EXIT_CRITICAL();
+}
+
+/*
+ * @brief Copy out a consistent snapshot of a task's statistics
+ */
+bool taskMonGet(uint8_t id, taskMonStats_t *out) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	if (id >= TASKMON_MAX_TASKS) {
+		return false;
+	}
+	OS_ENTER_CRITICAL();
+	*out = stats[id];
+	OS_EXIT_CRITICAL();
+	return true;
+}
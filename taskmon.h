@@ -0,0 +1,41 @@
+#ifndef __TASKMON_H__
+#define __TASKMON_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-task response time monitor. A task marks the start and end of each
+ * job; the time between them, in microseconds, goes into a fixed-bucket
+ * histogram and is checked against the task's deadline.
+ */
+
+enum {
+	TASKMON_MAX_TASKS = 8,
+	TASKMON_BUCKETS   = 8,   /* <=100us, <=500us, <=1ms, <=5ms, <=10ms, <=50ms, <=200ms, more */
+	TASKMON_NONE      = 0xFF /* no task, for ids carried in messages */
+};
+
+typedef struct {
+	uint32_t deadlineUs;
+	uint32_t count;          /* jobs recorded */
+	uint32_t misses;         /* jobs that took longer than deadlineUs */
+	uint32_t worstUs;
+	uint32_t histogram[TASKMON_BUCKETS];
+} taskMonStats_t;
+
+void taskMonInit(uint8_t id, uint32_t deadlineUs);
+void taskMonStart(uint8_t id);
+void taskMonEnd(uint8_t id);
+void taskMonRecord(uint8_t id, uint32_t us);
+bool taskMonGet(uint8_t id, taskMonStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
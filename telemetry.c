@@ -0,0 +1,170 @@
+
+#include <string.h>
+#include <LPC407x_8x_177x_8x.h>
+#include <ucos_ii.h>
+#include "telemetry.h"
+#include "crc16.h"
+
+enum {
+	FRAME_HEADER = 3UL,   /* sync, seq, len */
+	FRAME_CRC    = 2UL,
+	FRAME_SIZE   = FRAME_HEADER + TELEMETRY_BATCH_SIZE + FRAME_CRC
+};
+
+enum {
+	DMA_CONN_UART0_TX = 10UL   /* GPDMA request line of the UART0 transmitter */
+};
+
+static uint8_t batch[TELEMETRY_BATCH_SIZE];   /* records collected since the last frame */
+static uint32_t batchLen;
+static uint8_t frame[FRAME_SIZE];             /* frame owned by the DMA while busy */
+static volatile bool dmaBusy;
+static uint8_t frameSeq;
+static telemetryCounters_t counters;
+static OS_EVENT *batchStarted;                /* posted when a record lands in an empty batch */
+
+/*
+ * @brief Configure UART0 (P0.2/P0.3) for 8N1 with DMA requests, and the
+ *        GPDMA channel that feeds it
+ * @param baud - line rate in bits per second
+ */
+void telemetryInit(uint32_t baud) {
+	uint32_t divisor = PeripheralClock / (16UL * baud);
+
+	LPC_SC->PCONP |= (1UL << 3) | (1UL << 29); /* ensure power to UART0 and the GPDMA */
+	LPC_IOCON->P0_2 = (LPC_IOCON->P0_2 & ~0x07UL) | 0x01UL; /* TXD0 */
+	LPC_IOCON->P0_3 = (LPC_IOCON->P0_3 & ~0x07UL) | 0x01UL; /* RXD0 */
+
+	LPC_UART0->LCR = 0x83;                      /* 8 bits, no parity, 1 stop, DLAB on */
+	LPC_UART0->DLL = divisor & 0xFFUL;
+	LPC_UART0->DLM = (divisor >> 8) & 0xFFUL;
+	LPC_UART0->LCR = 0x03;                      /* DLAB off */
+	LPC_UART0->FCR = 0x0F;                      /* enable and reset FIFOs, DMA mode */
+	LPC_UART0->IER = 0;                         /* the DMA does all the work */
+
+	LPC_GPDMA->Config = 0x01;                   /* enable the GPDMA, little endian */
+	LPC_GPDMACH0->CConfig = 0;                  /* channel 0 idle until there is a frame */
+	LPC_GPDMA->IntTCClear = 0x01;
+	LPC_GPDMA->IntErrClr = 0x01;
+
+	batchLen = 0;
+	dmaBusy = false;
+	memset(&counters, 0, sizeof(counters));
+	batchStarted = OSSemCreate(0);
+	NVIC_EnableIRQ(DMA_IRQn);
+}
+
+/*
+ * @brief Add a record to the current batch. Never blocks: if the batch
+ *        has no room the record is counted as dropped.
+ */
+bool telemetryPost(telemetryType_t type, void const *data, uint8_t size) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	bool result = false;
+	bool first = false;
+
+	OS_ENTER_CRITICAL();
+	if (batchLen + 2UL + size <= TELEMETRY_BATCH_SIZE) {
+		first = (batchLen == 0);
+		batch[batchLen] = (uint8_t)type;
+		batch[batchLen + 1] = size;
+		memcpy(&batch[batchLen + 2], data, size);
+		batchLen += 2UL + size;
+		counters.records++;
+		result = true;
+	}
+	else {
+		counters.dropped++;
+	}
+	OS_EXIT_CRITICAL();
+
+	if (first) {
+		OSSemPost(batchStarted);
+	}
+	return result;
+}
+
+/*
+ * @brief Block the telemetry task until a new batch has been started or
+ *        timeout ticks have passed.
+ * @result true if there are records to send
+ */
+bool telemetryWait(uint32_t timeout) {
+	uint8_t err;
+
+	OSSemPend(batchStarted, timeout, &err);
+	return err == OS_ERR_NONE;
+}
+
+/*
+ * @brief Frame the current batch and start the DMA. Does nothing while the
+ *        previous frame is still being sent; its records stay batched.
+ * @result false if the batch could not be sent yet
+ */
+bool telemetryFlush(void) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+	uint32_t len;
+	uint16_t crc;
+
+	if (dmaBusy) {
+		return false;
+	}
+	OS_ENTER_CRITICAL();
+	len = batchLen;
+	memcpy(&frame[FRAME_HEADER], batch, len);
+	batchLen = 0;
+	OS_EXIT_CRITICAL();
+	if (len == 0) {
+		return true;
+	}
+
+	frame[0] = TELEMETRY_SYNC;
+	frame[1] = frameSeq++;
+	frame[2] = (uint8_t)len;
+	crc = crc16(frame, FRAME_HEADER + len);
+	frame[FRAME_HEADER + len] = (uint8_t)(crc & 0xFFU);
+	frame[FRAME_HEADER + len + 1] = (uint8_t)(crc >> 8);
+	len += FRAME_HEADER + FRAME_CRC;
+
+	counters.frames++;
+	counters.bytes += len;
+	dmaBusy = true;
+
+	LPC_GPDMACH0->CSrcAddr = (uint32_t)frame;
+	LPC_GPDMACH0->CDestAddr = (uint32_t)&LPC_UART0->THR;
+	LPC_GPDMACH0->CLLI = 0;
+	LPC_GPDMACH0->CControl = len                /* transfer size */
+	                       | (1UL << 26)        /* increment the source */
+	                       | (1UL << 31);       /* interrupt on terminal count */
+	LPC_GPDMACH0->CConfig = (1UL << 0)          /* enable */
+	                      | (DMA_CONN_UART0_TX << 6)
+	                      | (1UL << 11)         /* memory to peripheral */
+	                      | (1UL << 14)         /* error interrupt */
+	                      | (1UL << 15);        /* terminal count interrupt */
+	return true;
+}
+
+void telemetryGetCounters(telemetryCounters_t *out) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	OS_ENTER_CRITICAL();
+	*out = counters;
+	OS_EXIT_CRITICAL();
+}
+
+void DMA_IRQHandler(void) {
+	if (LPC_GPDMA->IntTCStat & 0x01UL) {
+		LPC_GPDMA->IntTCClear = 0x01;   /* frame sent */
+	}
+	if (LPC_GPDMA->IntErrStat & 0x01UL) {
+		LPC_GPDMA->IntErrClr = 0x01;    /* frame lost, carry on with the next one */
+	}
+	LPC_GPDMACH0->CConfig = 0;
+	dmaBusy = false;
+}
@@ -0,0 +1,82 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "taskmon.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary telemetry for the docking station. Records are batched in RAM and
+ * sent as one frame per batch over UART0 by the GPDMA:
+ *
+ *   0xA5 | seq | len | len bytes of records | CRC-16/CCITT (low byte first)
+ *
+ * and each record inside a frame is
+ *
+ *   type | size | size bytes of data
+ */
+
+enum {
+	TELEMETRY_SYNC       = 0xA5U,
+	TELEMETRY_BATCH_SIZE = 128UL   /* record bytes carried by one frame */
+};
+
+typedef enum {
+	TLM_STATE    = 1,   /* message id and the four data bytes sent to the LCD */
+	TLM_ACC      = 2,   /* min and max of every axis since the last summary */
+	TLM_COUNTERS = 3,   /* telemetryCounters_t, once a second */
+	TLM_POWER    = 4,   /* ticklessStats_t, once a second */
+	TLM_OS       = 5,   /* OS time and context switch count, two uint32_t, once a second */
+	TLM_TASKMON  = 6,   /* telemetryTaskMon_t, one task a second in turn */
+	TLM_FOOTPRINT = 7,  /* telemetryFootprint_t, once at start-up */
+	TLM_UI       = 8    /* telemetryUi_t, once a second while the display is drawing */
+} telemetryType_t;
+
+typedef struct {
+	uint8_t id;
+	uint8_t reserved;
+	uint16_t misses;         /* counts saturate at 0xFFFF */
+	uint32_t count;
+	uint32_t worstUs;
+	uint16_t histogram[TASKMON_BUCKETS];   /* the taskmon.h buckets */
+} telemetryTaskMon_t;
+
+typedef struct {
+	uint8_t tasks;
+	uint8_t queues;
+	uint16_t reserved;
+	uint32_t stackBytes;
+	uint32_t queueBytes;
+	uint32_t budgetBytes;
+} telemetryFootprint_t;
+
+typedef struct {
+	uint16_t fpsX10;        /* frames per second, times ten */
+	uint16_t dropped;       /* cosmetic rows put off because a frame ran over budget */
+	uint32_t frameAvgUs;    /* average time to draw one frame */
+	uint32_t lagAvgUs;      /* average time from putBufferSave to drawn row, queueing included */
+	uint32_t lagMaxUs;
+} telemetryUi_t;
+
+typedef struct {
+	uint32_t frames;     /* frames handed to the DMA */
+	uint32_t bytes;      /* bytes put on the wire, framing included */
+	uint32_t records;    /* records accepted */
+	uint32_t dropped;    /* records lost because the batch was full */
+} telemetryCounters_t;
+
+void telemetryInit(uint32_t baud);
+bool telemetryPost(telemetryType_t type, void const *data, uint8_t size);
+bool telemetryWait(uint32_t timeout);
+bool telemetryFlush(void);
+void telemetryGetCounters(telemetryCounters_t *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
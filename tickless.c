@@ -0,0 +1,153 @@
+
+#include <LPC407x_8x_177x_8x.h>
+#include <ucos_ii.h>
+#include "tickless.h"
+
+enum {
+	SYSTICK_ENABLE    = (1UL << 0),
+	SYSTICK_COUNTFLAG = (1UL << 16),
+	SYSTICK_MAX_LOAD  = 0x00FFFFFFUL,
+	TICKLESS_MIN_IDLE = 2UL   /* don't bother reprogramming for a single tick */
+};
+
+static uint32_t reload;       /* SysTick counts per OS tick, 0 until initialised */
+static uint32_t maxTicks;     /* longest sleep the 24 bit SysTick can time */
+static uint32_t sleepCycles;  /* part of a tick slept, not yet added to sleepTicks */
+static ticklessStats_t stats;
+
+/*
+ * @brief Enable tickless idle. Call once SysTick runs at tickHz.
+ * @param tickHz - the OS tick rate SysTick was configured for
+ */
+void ticklessInit(uint32_t tickHz) {
+	reload = SystemCoreClock / tickHz;
+	maxTicks = SYSTICK_MAX_LOAD / reload;
+}
+
+/*
+ * @brief Ticks until the earliest delayed task is due: 0 if a task other
+ *        than the idle task is ready, 0xFFFFFFFF if nothing is waiting on a delay.
+ *        Must be called with interrupts disabled.
+ */
+static uint32_t nextWake(void) {
+	OS_TCB *ptcb;
+	uint32_t ticks = 0xFFFFFFFFUL;
+
+	for (ptcb = OSTCBList; ptcb != (OS_TCB *)0; ptcb = ptcb->OSTCBNext) {
+		if (ptcb->OSTCBPrio == OS_TASK_IDLE_PRIO) {
+			continue;
+		}
+		if (ptcb->OSTCBDly != 0 && (ptcb->OSTCBStat & OS_STAT_SUSPEND) == 0) {
+			if (ptcb->OSTCBDly < ticks) {
+				ticks = ptcb->OSTCBDly;
+			}
+		}
+		else if (ptcb->OSTCBStat == OS_STAT_RDY) {
+			return 0;
+		}
+	}
+	return ticks;
+}
+
+static void addSleep(uint32_t cycles) {
+	sleepCycles += cycles;
+	stats.sleepTicks += sleepCycles / reload;
+	sleepCycles %= reload;
+}
+
+/*
+ * @brief Sleep until the next interrupt. When no task is due for several
+ *        ticks SysTick is stretched to fire when the earliest one is, and
+ *        the skipped ticks are replayed through OSTimeTick() on wake.
+ *        Called from the idle task hook.
+ */
+void ticklessIdle(void) {
+	uint32_t idle;
+	uint32_t ticks;
+	uint32_t before;
+	uint32_t after;
+	uint32_t load;
+	uint32_t since;
+	uint32_t elapsed;
+	uint32_t ctrl;
+	uint32_t next;
+
+	if (reload == 0) {
+		__WFI();
+		return;
+	}
+
+	__disable_irq();   /* WFI still wakes on a pending interrupt, it just isn't taken yet */
+	idle = nextWake();
+	if (idle < TICKLESS_MIN_IDLE) {
+		(void)SysTick->CTRL;                         /* clear a stale COUNTFLAG */
+		before = SysTick->VAL;
+		__DSB();
+		__WFI();
+		after = SysTick->VAL;
+		if (SysTick->CTRL & SYSTICK_COUNTFLAG) {
+			addSleep(before + (reload - after));
+		}
+		else {
+			addSleep(before - after);
+		}
+		stats.wakeups++;
+		__enable_irq();
+		return;
+	}
+
+	ticks = (idle < maxTicks) ? idle : maxTicks;
+	SysTick->CTRL &= ~SYSTICK_ENABLE;
+	before = SysTick->VAL;                           /* counts left in the current tick */
+	load = before + (ticks - 1UL) * reload;
+	SysTick->LOAD = load - 1UL;
+	SysTick->VAL = 0;
+	SysTick->CTRL |= SYSTICK_ENABLE;
+	SysTick->LOAD = reload - 1UL;                    /* used from the next reload on */
+
+	__DSB();
+	__WFI();
+
+	ctrl = SysTick->CTRL;                            /* reading clears COUNTFLAG, so read once */
+	SysTick->CTRL = ctrl & ~SYSTICK_ENABLE;
+	after = SysTick->VAL;
+	if (ctrl & SYSTICK_COUNTFLAG) {
+		/* slept the full period: the pending SysTick interrupt delivers the last
+		 * tick and the counter already reloaded with the normal period */
+		elapsed = ticks - 1UL;
+		addSleep(load);
+		SysTick->CTRL = ctrl | SYSTICK_ENABLE;
+	}
+	else {
+		/* woken early by another interrupt: resume mid-tick */
+		since = (reload - before) + (load - after);  /* counts since the last delivered tick */
+		elapsed = since / reload;
+		addSleep(load - after);
+		next = reload - since % reload;
+		if (next < 2UL) {
+			/* too close to the boundary to program, count that tick now */
+			elapsed++;
+			next += reload;
+		}
+		SysTick->LOAD = next - 1UL;
+		SysTick->VAL = 0;
+		SysTick->CTRL = ctrl | SYSTICK_ENABLE;
+		SysTick->LOAD = reload - 1UL;
+	}
+	while (elapsed-- > 0) {
+		OSTimeTick();
+	}
+	stats.suppressed++;
+	stats.wakeups++;
+	__enable_irq();
+}
+
+void ticklessGetStats(ticklessStats_t *out) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	OS_ENTER_CRITICAL();
+	*out = stats;
+	OS_EXIT_CRITICAL();
+}
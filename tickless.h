@@ -0,0 +1,24 @@
+#ifndef __TICKLESS_H__
+#define __TICKLESS_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t wakeups;      /* returns from sleep, for any reason */
+	uint32_t suppressed;   /* sleeps that skipped one or more ticks */
+	uint32_t sleepTicks;   /* time spent asleep, in OS ticks */
+} ticklessStats_t;
+
+void ticklessInit(uint32_t tickHz);
+void ticklessIdle(void);
+void ticklessGetStats(ticklessStats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,47 +1,92 @@
 #include <LPC407x_8x_177x_8x.h>
+#include <ucos_ii.h>
 #include "timer.h"
 
-static void (*timer0UserDefinedHandler)();
-static void (*timer1UserDefinedHandler)();
-static void (*sysTickUserDefinedHandler)();
+static void (*volatile timer0UserDefinedHandler)();
+static void (*timer1UserDefinedHandler)(uint32_t timestampUs);
 
-//void timer0Init(uint32_t tickHz, void (*handler)()) {
-//	LPC_SC->PCONP |= (1UL << 1); /* ensure power to TIMER0 */
-//	LPC_TIM0->TCR = 0; /* disable the timer during configuration */
-//	LPC_TIM0->PR = 0; /* don't scale peripheral clock */
-//	LPC_TIM0->CTCR = 0; /* select timer mode, not counter mode */
-//	LPC_TIM0->MR0 = PeripheralClock / tickHz - 1; /* set match register for required rate */
-//	LPC_TIM0->MCR = 0x03UL; /* interrupt and reset on match */
-//	timer0UserDefinedHandler = handler; /* install the user-defined handler */
-//	LPC_TIM0->IR = 0x3F; /* reset all TIMER0 interrupts */
-//	NVIC_EnableIRQ(TIMER0_IRQn); /* enable the TIMER0 interrupt in the NVIC */
-//	LPC_TIM0->TCR |= (1UL << 0); /* enable the timer */
-//}
+/*
+ * @brief Start TIMER0 and TIMER1 as free-running 32-bit microsecond counters.
+ *        Both use the same prescaler and are started together, so a TIMER1
+ *        capture is a timestamp on the TIMER0 timebase. The count wraps
+ *        after about 71 minutes; compare times with (int32_t)(a - b).
+ */
+void usTimerInit(void) {
+	LPC_SC->PCONP |= (1UL << 1) | (1UL << 2); /* ensure power to TIMER0 and TIMER1 */
+	LPC_TIM0->TCR = 0x02;                     /* disable and reset during configuration */
+	LPC_TIM1->TCR = 0x02;
+	LPC_TIM0->PR = PeripheralClock / 1000000UL - 1UL; /* count microseconds */
+	LPC_TIM1->PR = PeripheralClock / 1000000UL - 1UL;
+	LPC_TIM0->CTCR = 0;                       /* select timer mode, not counter mode */
+	LPC_TIM1->CTCR = 0;
+	LPC_TIM0->MCR = 0;                        /* no match events until one is scheduled */
+	LPC_TIM1->MCR = 0;
+	LPC_TIM1->CCR = 0;                        /* no capture until one is requested */
+	LPC_TIM0->IR = 0x3F;                      /* reset all TIMER0 interrupts */
+	LPC_TIM1->IR = 0x3F;                      /* reset all TIMER1 interrupts */
+	NVIC_EnableIRQ(TIMER0_IRQn);              /* enable the TIMER0 interrupt in the NVIC */
+	NVIC_EnableIRQ(TIMER1_IRQn);              /* enable the TIMER1 interrupt in the NVIC */
+	LPC_TIM0->TCR = 0x01;                     /* enable both timers back to back */
+	LPC_TIM1->TCR = 0x01;
+}
+
+/*
+ * @brief Current time in microseconds
+ */
+uint32_t usTimeNow(void) {
+	return LPC_TIM0->TC;
+}
+
+/*
+ * @brief Call handler once, from the TIMER0 interrupt, when the timebase
+ *        reaches atUs. A time already in the past fires straight away.
+ *        The handler must not call OS services.
+ * @result false if another callback is still scheduled
+ */
+bool usTimerSchedule(uint32_t atUs, void (*handler)(void)) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	OS_ENTER_CRITICAL();                      /* check and install as one step */
+	if (timer0UserDefinedHandler != 0) {
+		OS_EXIT_CRITICAL();
+		return false;
+	}
+	timer0UserDefinedHandler = handler;       /* install the user-defined handler */
+	LPC_TIM0->MR0 = atUs;
+	LPC_TIM0->IR = (1UL << 0);                /* clear a stale MR0 match */
+	LPC_TIM0->MCR = 0x01UL;                   /* interrupt on match, keep counting */
+	if ((int32_t)(LPC_TIM0->TC - atUs) >= 0) {
+		NVIC_SetPendingIRQ(TIMER0_IRQn);      /* missed it while setting up */
+	}
+	OS_EXIT_CRITICAL();
+	return true;
+}
 
-//void timer1Init(uint32_t tickHz, void (*handler)()) {
-//	LPC_SC->PCONP |= (1UL << 2); /* ensure power to TIMER1 */
-//	LPC_TIM1->TCR = 0; /* disable the timer during configuration */
-//	LPC_TIM1->PR = 0; /* don't scale peripheral clock */
-//	LPC_TIM1->CTCR = 0; /* select timer mode, not counter mode */
-//	LPC_TIM1->MR0 = PeripheralClock / tickHz - 1; /* set match register for required rate */
-//	LPC_TIM1->MCR = 0x03UL; /* interrupt and reset on match */
-//	timer1UserDefinedHandler = handler; /* install the user-defined handler */
-//	LPC_TIM1->IR = 0x3F; /* reset all TIMER1 interrupts */
-//	NVIC_EnableIRQ(TIMER1_IRQn); /* enable the TIMER1 interrupt in the NVIC */
-//	LPC_TIM1->TCR |= (1UL << 0); /* enable the timer */
-//}
+void usTimerCancel(void) {
+#if OS_CRITICAL_METHOD == 3
+	OS_CPU_SR cpu_sr = 0;
+#endif
+
+	OS_ENTER_CRITICAL();
+	LPC_TIM0->MCR = 0;
+	LPC_TIM0->IR = (1UL << 0);
+	timer0UserDefinedHandler = 0;
+	OS_EXIT_CRITICAL();
+}
 
 /*
- * @brief Configure the SysTick timer to generate an interrupt 
- * @param tickHz - frequency at which to generate the interrupt
- * @param handler - the user-defined handler for the interrupt
+ * @brief Timestamp edges on T1_CAP1 (P1.19). handler is called from the
+ *        TIMER1 interrupt with the microsecond time of each edge and must
+ *        not call OS services.
  */
-void sysTickInit(uint32_t tickHz, void (*handler)()) {
-	SysTick->CTRL = 0;                              /* disable timer during configuration */
-	SysTick->LOAD = SystemCoreClock / tickHz - 1UL; /* fill the RELOAD register with a value for the rate */
-	SysTick->VAL = 0UL;                             /* any value written here resets the value counter to 0 */
-	sysTickUserDefinedHandler = handler;
-	SysTick->CTRL = 0x07;                           /* enable the counter, enable the interrupt, choose CPU clock */
+void usCaptureInit(usCaptureEdge_t edge, void (*handler)(uint32_t timestampUs)) {
+	LPC_IOCON->P1_19 = (LPC_IOCON->P1_19 & ~0x07UL) | 0x03UL; /* select T1_CAP1 */
+	timer1UserDefinedHandler = handler;       /* install the user-defined handler */
+	LPC_TIM1->IR = (1UL << 5);                /* clear a stale CR1 capture */
+	LPC_TIM1->CCR = ((uint32_t)edge << 3)     /* capture on the chosen edges into CR1 */
+	              | (1UL << 5);               /* and interrupt */
 }
 
 void softTimerInit(softTimer_t *timer, uint32_t tickHz, void (*handler)()) {
@@ -50,17 +95,20 @@ void softTimerInit(softTimer_t *timer, uint32_t tickHz, void (*handler)()) {
 	timer->handler = handler;
 }
 
-//void TIMER0_IRQHandler(void) {
-//	timer0UserDefinedHandler(); /* call the user-defined handler */
-//	LPC_TIM0->IR |= (1UL << 0); /* clear the interrupt on MR0 */
-//}
+void TIMER0_IRQHandler(void) {
+	void (*handler)(void) = timer0UserDefinedHandler;
 
-//void TIMER1_IRQHandler(void) {
-//	timer1UserDefinedHandler(); /* call the user-defined handler */
-//	LPC_TIM1->IR |= (1UL << 0); /* clear the interrupt on MR0 */
-//}
-
-void SysTick_Handler(void) {
-	sysTickUserDefinedHandler();
+	LPC_TIM0->IR = (1UL << 0);                /* clear the interrupt on MR0 */
+	if (handler != 0 && (int32_t)(LPC_TIM0->TC - LPC_TIM0->MR0) >= 0) {
+		LPC_TIM0->MCR = 0;                    /* one shot */
+		timer0UserDefinedHandler = 0;
+		handler();                            /* call the user-defined handler */
+	}
 }
 
+void TIMER1_IRQHandler(void) {
+	LPC_TIM1->IR = (1UL << 5);                /* clear the interrupt on CR1 */
+	if (timer1UserDefinedHandler != 0) {
+		timer1UserDefinedHandler(LPC_TIM1->CR1); /* call the user-defined handler */
+	}
+}
@@ -2,6 +2,17 @@
 #define __TIMER_H__
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * SysTick belongs to the kernel: main() starts it with SysTick_Config and the
+ * uC/OS-II port's SysTick_Handler calls OSTimeTick. tickless.c reprograms it
+ * while idle, so this module leaves it alone and only owns TIMER0/TIMER1.
+ */
 
 typedef struct {
 	volatile uint32_t count;
@@ -9,11 +20,23 @@ typedef struct {
 	void (*handler)(void);
 } softTimer_t;
 
-void timer0Init(uint32_t tickHz, void (*handler)());
-void timer1Init(uint32_t tickHz, void (*handler)());
-void sysTickInit(uint32_t tickHz, void (*handler)());
+typedef enum {
+	US_CAPTURE_RISING  = 1,
+	US_CAPTURE_FALLING = 2,
+	US_CAPTURE_BOTH    = 3
+} usCaptureEdge_t;
+
+void usTimerInit(void);
+uint32_t usTimeNow(void);
+bool usTimerSchedule(uint32_t atUs, void (*handler)(void));
+void usTimerCancel(void);
+void usCaptureInit(usCaptureEdge_t edge, void (*handler)(uint32_t timestampUs));
 void softTimerInit(softTimer_t *timer, uint32_t tickHz, void (*handler)());
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
 